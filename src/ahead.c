@@ -0,0 +1,167 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file ahead.c Read-ahead thread.
+ * Reading and decompressing an input is done by a thread of its own that
+ * keeps up to AHEAD_SLOTS blocks ahead of the consumer. Several inputs
+ * read in turn, e.g. when merging trails, thus don't wait for each other.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "misc.h"
+#include "ahead.h"
+#include "config.h"
+
+/**
+ * Thread filling the slots of a read-ahead. The thread ends at the end of
+ * the data, on a failure or if it is stopped.
+ * @param arg read-ahead
+ * @return NULL
+ */
+static void *ahead_thread(void *arg)
+{
+   ahead_t *a = arg;
+   int slot, len;
+
+   pthread_mutex_lock(&a->lock);
+   while (!a->done) {
+      while (a->count == AHEAD_SLOTS && !a->stop)
+	 pthread_cond_wait(&a->cond, &a->lock);
+      if (a->stop)
+	 break;
+
+      /*
+       * The slot is owned by the thread until it is counted.
+       */
+      slot = (a->head + a->count) % AHEAD_SLOTS;
+      pthread_mutex_unlock(&a->lock);
+      len = a->fn_read(a->arg, a->slots + slot * a->size, a->size);
+      pthread_mutex_lock(&a->lock);
+
+      a->lens[slot] = len;
+      a->count++;
+      if (len != a->size)
+	 a->done = 1;
+      pthread_cond_broadcast(&a->cond);
+   }
+   pthread_mutex_unlock(&a->lock);
+
+   return NULL;
+}
+
+/**
+ * Start reading ahead.
+ * @param fn_read callback reading blocks
+ * @param arg argument of callback
+ * @param size size of blocks
+ * @return read-ahead or NULL on failure
+ */
+ahead_t *ahead_start(ahead_fn_read_t fn_read, void *arg, int size)
+{
+   ahead_t *a;
+
+   if (!(a = calloc(1, sizeof(ahead_t))))
+      return NULL;
+
+   if (!(a->slots = malloc(AHEAD_SLOTS * size))) {
+      free(a);
+      return NULL;
+   }
+
+   a->fn_read = fn_read;
+   a->arg = arg;
+   a->size = size;
+   pthread_mutex_init(&a->lock, NULL);
+   pthread_cond_init(&a->cond, NULL);
+
+   if (pthread_create(&a->thread, NULL, ahead_thread, a)) {
+      pthread_mutex_destroy(&a->lock);
+      pthread_cond_destroy(&a->cond);
+      free(a->slots);
+      free(a);
+      return NULL;
+   }
+
+   return a;
+}
+
+/**
+ * Take the next block of a read-ahead. The call blocks until the thread
+ * has read the block.
+ * @param a read-ahead
+ * @param buf buffer of block size
+ * @return number of bytes, 0 at the end of the data or -1 on failure
+ */
+int ahead_read(ahead_t * a, uchar_t * buf)
+{
+   int len = 0;
+
+   pthread_mutex_lock(&a->lock);
+   while (!a->count && !a->done)
+      pthread_cond_wait(&a->cond, &a->lock);
+
+   if (a->count) {
+      len = a->lens[a->head];
+      if (len > 0)
+	 memcpy(buf, a->slots + a->head * a->size, len);
+
+      a->head = (a->head + 1) % AHEAD_SLOTS;
+      a->count--;
+      pthread_cond_broadcast(&a->cond);
+   }
+   pthread_mutex_unlock(&a->lock);
+
+   return len;
+}
+
+/**
+ * Stop reading ahead and free the read-ahead. Buffered blocks are
+ * discarded.
+ * @param a read-ahead
+ */
+void ahead_stop(ahead_t * a)
+{
+   if (!a)
+      return;
+
+   pthread_mutex_lock(&a->lock);
+   a->stop = 1;
+   pthread_cond_broadcast(&a->cond);
+   pthread_mutex_unlock(&a->lock);
+
+   pthread_join(a->thread, NULL);
+   pthread_mutex_destroy(&a->lock);
+   pthread_cond_destroy(&a->cond);
+   free(a->slots);
+   free(a);
+}
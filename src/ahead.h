@@ -0,0 +1,64 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file ahead.h Read-ahead thread header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _AHEAD_H
+#define _AHEAD_H
+
+#define AHEAD_SLOTS       8		/**< Number of buffered blocks */
+
+/**
+ * Callback reading the next block of data. It returns the number of bytes
+ * read, which is less than the block size only at the end of the data, or
+ * -1 on failure.
+ */
+typedef int (*ahead_fn_read_t) (void *arg, uchar_t * buf, int len);
+
+/**
+ * Read-ahead of a data source. A thread reads blocks into a queue of
+ * slots while the consumer takes blocks from its head.
+ */
+typedef struct s_ahead {
+   pthread_t thread;		     /**< Reading thread */
+   pthread_mutex_t lock;	     /**< Lock of queue */
+   pthread_cond_t cond;		     /**< Change of queue */
+   ahead_fn_read_t fn_read;	     /**< Reading callback */
+   void *arg;			     /**< Argument of callback */
+   int size;			     /**< Size of blocks */
+   uchar_t *slots;		     /**< Buffered blocks */
+   int lens[AHEAD_SLOTS];	     /**< Lengths of buffered blocks */
+   int head;			     /**< Slot of next block */
+   int count;			     /**< Number of buffered blocks */
+   int done;			     /**< Source is exhausted */
+   int stop;			     /**< Thread has to stop */
+} ahead_t;
+
+ahead_t *ahead_start(ahead_fn_read_t fn_read, void *arg, int size);
+int ahead_read(ahead_t * a, uchar_t * buf);
+void ahead_stop(ahead_t * a);
+
+#endif				/* _AHEAD_H */
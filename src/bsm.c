@@ -30,77 +30,261 @@
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <bsm/audit.h>
 #include <bsm/audit_record.h>
 
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <zlib.h>
+#include <pthread.h>
 
 #include "misc.h"
+#include "kern.h"
+#include "field.h"
 #include "bsm.h"
+#include "filter.h"
+#include "emit.h"
+#include "cmap.h"
+#include "cols.h"
+#include "idx.h"
+#include "zidx.h"
+#include "ahead.h"
+#include "part.h"
+#include "rot.h"
+#include "mout.h"
+#include "uring.h"
 #include "config.h"
 
+extern int resync;
+extern uint64_t time_from, time_to;
+
 static int errnum;
-static uchar_t buffer[BUFFER_SIZE];
-static uchar_t trace[TRACE_SIZE];
-static uchar_t trace_ptr = 0;
-static int bufptr = 0, eof_flag = 0;
-static int bufseg = BUFFER_SEGMENTS - 1;
 
-uchar_t read_char(gzFile *in, int pos)
+static int bsm_put_record(bsm_out_t * o, int len);
+static int bsm_direct(bsm_stream_t * s);
+static int bsm_fill(void *arg, uchar_t * buf, int len);
+int check_buffer(bsm_stream_t * s, int pos);
+
+/**
+ * Initialize the buffer of a freshly opened stream.
+ * @param s stream
+ * @param name name of stream
+ */
+static void bsm_init(bsm_stream_t * s, char *name)
 {
-   uchar_t ret;
-   int bufpos, i;
-   
-   bufpos = (bufptr + pos)%BUFFER_SIZE; 
-   check_buffer(in, bufpos);
-   
-   for(i = 0; i  < sizeof(uchar_t) ; i++) {
-      bufpos = (bufptr + i + pos)%BUFFER_SIZE;
-      check_buffer(in, bufpos);
-      ((uchar_t *)&ret)[i] = buffer[bufpos];
-   }   
+   s->name = name;
+   s->quiet = 0;
+   s->trace_ptr = 0;
+   memset(s->trace, 0, TRACE_SIZE);
+   s->bufptr = 0;
+   s->bufseg = BUFFER_SEGMENTS - 1;
+   s->eof_flag = 0;
+   s->o_pos = s->o_read = 0;
+   s->str_left = 0;
+   s->chunk = 0;
+   s->skipped = 0;
+   s->windowed = 0;
+   s->next = 0;
+   s->direct = -1;
+   s->zidx = NULL;
+   s->zin = NULL;
+   s->ahead = NULL;
+   s->uring = NULL;
+}
 
-   return ret;
+/**
+ * Open an audit trail file for reading.
+ * @param name name of file
+ * @return stream or NULL on failure
+ */
+bsm_stream_t *bsm_open(char *name)
+{
+   bsm_stream_t *s;
+
+   if (!(s = malloc(sizeof(bsm_stream_t))))
+      return NULL;
+
+   s->fd = open(name, O_RDONLY);
+   if (s->fd < 0 || !(s->in = gzdopen(s->fd, "rb"))) {
+      if (s->fd >= 0)
+	 close(s->fd);
+      free(s);
+      return NULL;
+   }
+
+   bsm_init(s, name);
+
+   /*
+    * Uncompressed files are read through io_uring if possible.
+    */
+   if (bsm_direct(s))
+      s->uring = uring_reader(s->fd, 0);
+
+   return s;
 }
 
-ushort_t read_short(gzFile *in, int pos)
+/**
+ * Open an audit trail for reading from a file descriptor.
+ * @param fd file descriptor
+ * @param name name used in messages
+ * @return stream or NULL on failure
+ */
+bsm_stream_t *bsm_dopen(int fd, char *name)
 {
-   ushort_t ret;
-   int bufpos, i;
-   
-   bufpos = (bufptr + pos)%BUFFER_SIZE; 
-   check_buffer(in, bufpos);
-   
-   for(i = 0; i  < sizeof(ushort_t) ; i++) {
-      bufpos = (bufptr + i + pos)%BUFFER_SIZE;
-      check_buffer(in, bufpos);
-      ((uchar_t *)&ret)[i] = buffer[bufpos];
-   }   
+   bsm_stream_t *s;
 
-   return ret;
+   if (!(s = malloc(sizeof(bsm_stream_t))))
+      return NULL;
+
+   s->fd = fd;
+   s->in = gzdopen(fd, "rb");
+   if (!s->in) {
+      free(s);
+      return NULL;
+   }
+
+   bsm_init(s, name);
+   return s;
 }
 
+/**
+ * Close a stream and free its memory.
+ * @param s stream
+ */
+void bsm_close(bsm_stream_t * s)
+{
+   ahead_stop(s->ahead);
+   uring_close(s->uring);
+   zidx_end(s->zin);
+   zidx_close(s->zidx);
+   gzclose(s->in);
+   free(s);
+}
+
+/**
+ * Check whether a stream reads an uncompressed file. The result is
+ * determined once, as it must not be queried while a read-ahead thread
+ * uses the file.
+ * @param s stream
+ * @return 1 if the file is uncompressed or 0 otherwise
+ */
+static int bsm_direct(bsm_stream_t * s)
+{
+   if (s->direct < 0)
+      s->direct = gzdirect(s->in);
+
+   return s->direct;
+}
+
+/**
+ * Read a stream ahead in a thread of its own. Reading and decompressing
+ * then overlap with the processing of the stream.
+ * @param s stream
+ * @return 1 on success or 0 on failure
+ */
+int bsm_ahead(bsm_stream_t * s)
+{
+   bsm_direct(s);
+   if (!s->ahead)
+      s->ahead = ahead_start(bsm_fill, s, BUFFER_SEG_SIZE);
+
+   return s->ahead != NULL;
+}
+
+/**
+ * Determine the size of the uncompressed data of a stream. The size of a
+ * compressed file is taken from a cached gzip index. Without index, it is
+ * extrapolated from the compression ratio of the data read so far, as
+ * building an index would decompress the whole file.
+ * @param s stream
+ * @return size in bytes or -1 if the stream is not a regular file
+ */
+long long bsm_size(bsm_stream_t * s)
+{
+   struct stat st;
+   off_t in;
+
+   if (fstat(s->fd, &st) || !S_ISREG(st.st_mode))
+      return -1;
+
+   if (bsm_direct(s))
+      return st.st_size;
+
+   if (s->zidx || (s->zidx = zidx_open(s->name, s->fd, 0)))
+      return s->zidx->size;
+
+   if (s->eof_flag)
+      return s->o_read;
+
+   /*
+    * The descriptor is positioned after the compressed data read.
+    */
+   if ((in = lseek(s->fd, 0, SEEK_CUR)) <= 0)
+      return -1;
+
+   return (long long) ((double) st.st_size * s->o_read / in);
+}
 
-uint32_t read_int(gzFile *in, int pos)
+/**
+ * Copy bytes of the current token out of the ring buffer. Segments are
+ * loaded as needed and the copy may wrap around the end of the buffer.
+ * @param s stream
+ * @param pos offset from the start of the token
+ * @param b destination
+ * @param n number of bytes
+ */
+static void read_bytes(bsm_stream_t * s, int pos, uchar_t * b, int n)
 {
-   uint32_t ret;
    int bufpos, i;
-   
-   bufpos = (bufptr + pos)%BUFFER_SIZE; 
-   check_buffer(in, bufpos);
-   
-   for(i = 0; i  < sizeof(uint32_t) ; i++) {
-      bufpos = (bufptr + i + pos)%BUFFER_SIZE;
-      check_buffer(in, bufpos);
-      ((uchar_t *)&ret)[i] = buffer[bufpos];
-   }   
 
+   for (i = 0; i < n; i++) {
+      bufpos = (s->bufptr + i + pos) % BUFFER_SIZE;
+      check_buffer(s, bufpos);
+      b[i] = s->buffer[bufpos];
+   }
+}
+
+uchar_t read_char(bsm_stream_t * s, int pos)
+{
+   uchar_t ret;
+
+   read_bytes(s, pos, &ret, 1);
    return ret;
 }
 
+/**
+ * Read a 2 byte field of the current token in network byte order.
+ * @param s stream
+ * @param pos offset from the start of the token
+ * @return value of field
+ */
+ushort_t read_short(bsm_stream_t * s, int pos)
+{
+   uchar_t b[2];
+
+   read_bytes(s, pos, b, sizeof(b));
+   return field_get16(b);
+}
+
+/**
+ * Read a 4 byte field of the current token in network byte order.
+ * @param s stream
+ * @param pos offset from the start of the token
+ * @return value of field
+ */
+uint32_t read_int(bsm_stream_t * s, int pos)
+{
+   uchar_t b[4];
+
+   read_bytes(s, pos, b, sizeof(b));
+   return field_get32(b);
+}
 
 /**
  * Return the size of the audit unit. The given audit unit number is
@@ -131,25 +315,33 @@ uchar_t get_unit_size(uchar_t unit)
  * Retrieve the size of the strings within the stream. The function looks
  * for num strings within the stream at the given position. The function
  * counts all used bytes and returns the space used by the strings and their
- * terminating null-characters.
- * @param in stream
+ * terminating null-characters. The strings are scanned one contiguous part
+ * of a buffer segment at a time.
+ * @param s stream
  * @param pos position
  * @param num number of strings
  * @return size of strings within the stream
  */
-uint32_t strings_size(gzFile * in, int pos, int num)
+uint32_t strings_size(bsm_stream_t * s, int pos, int num)
 {
-   int bufpos, i, bytes = 0;
+   int bufpos, len, bytes = 0;
+   unsigned int n = num;
+
+   while (n > 0) {
+      bufpos = (s->bufptr + pos + bytes) % BUFFER_SIZE;
+      if (!check_buffer(s, bufpos))
+	 break;
 
-   bufpos = (bufptr + pos)%BUFFER_SIZE;
-   check_buffer(in, bufpos);
+      /*
+       * Scan up to the end of the segment or the end of the stream.
+       */
+      len = BUFFER_SEG_SIZE - bufpos % BUFFER_SEG_SIZE;
+      if (len > s->o_read - s->o_pos - pos - bytes)
+	 len = s->o_read - s->o_pos - pos - bytes;
+      if (len <= 0)
+	 break;
 
-   for (i = 0; i < num; i++) {
-      do {
-	 bufpos = (bufptr + pos + bytes)%BUFFER_SIZE;
-	 check_buffer(in, bufpos);
-	 bytes++;
-      } while (buffer[bufpos] != 0);
+      bytes += kern_skip_nuls(s->buffer + bufpos, len, &n);
    }
 
    return bytes;
@@ -160,11 +352,11 @@ uint32_t strings_size(gzFile * in, int pos, int num)
  * size is returned, in case of dynamic tokens such as the path token, the
  * size of the dynamic parts are determined by reading information from the
  * screen. The sizes have been taken from audit.log(4).
+ * @param s stream
  * @param id token id
- * @param in stream
  * @return size of token or -1 if no token could be found
  */
-int get_token_size(gzFile *in, uchar_t id)
+int get_token_size(bsm_stream_t * s, uchar_t id)
 {
    int token_size, tmp;
 
@@ -174,9 +366,9 @@ int get_token_size(gzFile *in, uchar_t id)
       token_size = 1 + 4 + 1 + 2 + 2 + 4 + 4;
       break;
    case AUT_HEADER32_EX:
-      token_size = 1 + 4 + 1 + 2 + 2 + 2 + 4 + 4;
-      tmp = read_short(in, 10);
-      if (tmp == 16)
+      token_size = 1 + 4 + 1 + 2 + 2 + 4 + 4 + 4;
+      tmp = read_int(s, 10);
+      if (tmp == AU_IPv6)
 	 token_size += 16;
       else
 	 token_size += 4;
@@ -185,9 +377,9 @@ int get_token_size(gzFile *in, uchar_t id)
       token_size = 1 + 4 + 1 + 2 + 2 + 8 + 8;
       break;
    case AUT_HEADER64_EX:
-      token_size = 1 + 4 + 1 + 2 + 2 + 2 + 8 + 8;
-      tmp = read_short(in, 10);
-      if (tmp == 16)
+      token_size = 1 + 4 + 1 + 2 + 2 + 4 + 8 + 8;
+      tmp = read_int(s, 10);
+      if (tmp == AU_IPv6)
 	 token_size += 16;
       else
 	 token_size += 4;
@@ -195,7 +387,7 @@ int get_token_size(gzFile *in, uchar_t id)
    case AUT_OTHER_FILE64:
    case AUT_OTHER_FILE32:
       token_size = 1 + 4 + 4 + 2;
-      token_size += read_short(in, token_size - 2);
+      token_size += read_short(s, token_size - 2);
       break;
    case AUT_ATTR:
       token_size = 1 + 4 + 4 + 4 + 8 + 4;
@@ -212,9 +404,9 @@ int get_token_size(gzFile *in, uchar_t id)
       break;
    case AUT_PROCESS32_EX:
    case AUT_SUBJECT32_EX:
-      token_size = 1 + 4 + 4 + 4 + 4 + 4 + 4 + 4 + 4 + 2;
-      tmp = read_short(in, token_size - 2);
-      if (tmp == 16)
+      token_size = 1 + 4 + 4 + 4 + 4 + 4 + 4 + 4 + 4 + 4;
+      tmp = read_int(s, token_size - 4);
+      if (tmp == AU_IPv6)
 	 token_size += 16;
       else
 	 token_size += 4;
@@ -225,9 +417,9 @@ int get_token_size(gzFile *in, uchar_t id)
       break;
    case AUT_PROCESS64_EX:
    case AUT_SUBJECT64_EX:
-      token_size = 1 + 4 + 4 + 4 + 4 + 4 + 4 + 4 + 8 + 2;
-      tmp = read_short(in, token_size - 2);
-      if (tmp == 16)
+      token_size = 1 + 4 + 4 + 4 + 4 + 4 + 4 + 4 + 8 + 4;
+      tmp = read_int(s, token_size - 4);
+      if (tmp == AU_IPv6)
 	 token_size += 16;
       else
 	 token_size += 4;
@@ -243,31 +435,31 @@ int get_token_size(gzFile *in, uchar_t id)
       break;
    case AUT_ARG32:
       token_size = 1 + 1 + 4 + 2;
-      token_size += read_short(in, token_size - 2);
+      token_size += read_short(s, token_size - 2);
       break;
    case AUT_ARG64:
       token_size = 1 + 1 + 8 + 2;
-      token_size += read_short(in, token_size - 2);
+      token_size += read_short(s, token_size - 2);
       break;
    case AUT_PATH:
    case AUT_TEXT:
       token_size = 1 + 2;
-      token_size += read_short(in, token_size - 2);
+      token_size += read_short(s, token_size - 2);
       break;
    case AUT_EXEC_ARGS:
    case AUT_EXEC_ENV:
       token_size = 1 + 4;
-      tmp = read_int(in, token_size - 4);
-      token_size += strings_size(in, token_size, tmp);
+      tmp = read_int(s, token_size - 4);
+      token_size += strings_size(s, token_size, tmp);
       break;
    case AUT_SEQ:
    case AUT_IN_ADDR:
       token_size = 1 + 4;
       break;
    case AUT_IN_ADDR_EX:
-      token_size = 1 + 2;
-      tmp = read_short(in, token_size - 2);
-      if (tmp == 16)
+      token_size = 1 + 4;
+      tmp = read_int(s, token_size - 4);
+      if (tmp == AU_IPv6)
 	 token_size += 16;
       else
 	 token_size += 4;
@@ -280,8 +472,8 @@ int get_token_size(gzFile *in, uchar_t id)
       break;
    case AUT_SOCKET_EX:
       token_size = 1 + 2 + 2 + 2 + 2 + 2;
-      tmp = read_short(in, 5);
-      if (tmp == 16)
+      tmp = read_short(s, 5);
+      if (tmp == AU_IPv6)
 	 token_size += 16 * 2;
       else
 	 token_size += 4 * 2;
@@ -291,7 +483,7 @@ int get_token_size(gzFile *in, uchar_t id)
       break;
    case AUT_GROUPS:
       token_size = 1 + 2;
-      token_size += read_short(in, token_size - 2) * 4;
+      token_size += read_short(s, token_size - 2) * 4;
       break;
    case AUT_EXIT:
       token_size = 1 + 4 + 4;
@@ -304,66 +496,695 @@ int get_token_size(gzFile *in, uchar_t id)
       break;
    case AUT_DATA:
       token_size = 1 + 1 + 1 + 1;
-      tmp = read_char(in, token_size - 1);
-      token_size += tmp * get_unit_size(read_char(in, token_size - 2));
+      tmp = read_char(s, token_size - 1);
+      token_size += tmp * get_unit_size(read_char(s, token_size - 2));
       break;
    default:
-      err_msg("Unknown token ID 0x%.2x at %ld.", id, gztell(in));
+      token_size = -1;
+      if (s->quiet)
+         break;
+
+      err_msg("Unknown token ID 0x%.2x at %ld in %s.", id, s->o_pos,
+              s->name);
       fprintf(stderr, "Token ID trace: ");
       for(tmp = 0; tmp < TRACE_SIZE ; tmp++) {
-         fprintf(stderr, " ID 0x%2.x ", trace[(trace_ptr + tmp)%TRACE_SIZE]);
+         fprintf(stderr, " ID 0x%2.x ",
+                 s->trace[(s->trace_ptr + tmp)%TRACE_SIZE]);
          if(tmp <  TRACE_SIZE - 1) 
             fprintf(stderr, "->");
       }
       fprintf(stderr, "\n");
-      exit(0);
-      token_size = -1;
    }
    return token_size;
 }
 
-int check_buffer(gzFile *in, int pos)
+/**
+ * Read the next segment of a stream from its file. A stream repositioned
+ * within a compressed file is read through the gzip index. This function
+ * is called by the read-ahead thread of a stream, if there is one.
+ * @param arg stream
+ * @param buf buffer
+ * @param len length of segment
+ * @return number of bytes read, which is less than len only at the end of
+ * the file, or -1 on failure
+ */
+static int bsm_fill(void *arg, uchar_t * buf, int len)
 {
-   int bufpos, r, ret;
+   bsm_stream_t *s = arg;
+   int ret;
 
-   if(pos/BUFFER_SEG_SIZE <= bufseg && 
-      bufseg - pos/BUFFER_SEG_SIZE < BUFFER_SEGMENTS - 1)
-      return 1;
+   if (s->zin)
+      return zidx_read(s->zin, buf, len);
+
+   if (s->uring)
+      return uring_read(s->uring, buf, len);
+
+   ret = gzread(s->in, buf, len);
+   if (ret == -1)
+      err_msg("gzread: %s", gzerror(s->in, &errnum));
 
-   if(pos/BUFFER_SEG_SIZE == BUFFER_SEGMENTS - 1 &&
-      bufseg == 0)
-      return 1; 
+   return ret;
+}
+
+/**
+ * Make sure that the given position of the ring buffer has been read from
+ * the stream. Segments are read ahead until the segment of the position is
+ * the most recently read one. The number of bytes read is counted, so
+ * that the end of the stream is only reported after all bytes have been
+ * consumed.
+ * @param s stream
+ * @param pos position in ring buffer
+ * @return 1 on success or 0 on failure
+ */
+int check_buffer(bsm_stream_t * s, int pos)
+{
+   int r, ret;
+
+   /*
+    * The segment following the most recent one holds the oldest data, a
+    * position in it has to be read anew.
+    */
+   if((s->bufseg - pos/BUFFER_SEG_SIZE + BUFFER_SEGMENTS) % BUFFER_SEGMENTS
+      < BUFFER_SEGMENTS - 1)
+      return 1;
 
    r = 0;
    
-   while(pos/BUFFER_SEG_SIZE != bufseg) {
-      bufseg = (bufseg + 1) % BUFFER_SEGMENTS;
+   while(pos/BUFFER_SEG_SIZE != s->bufseg) {
+      s->bufseg = (s->bufseg + 1) % BUFFER_SEGMENTS;
       r++;
 
-      ret = gzread(in, buffer + bufseg * BUFFER_SEG_SIZE, BUFFER_SEG_SIZE);
-      if(ret == -1) {
-         err_msg("gzread: %s", gzerror(in, &errnum));
-         return 0;
-      }
-      
       if(r > BUFFER_SEGMENTS) {
          err_msg("Read beyond buffer space. Oops.");
          return 0;
       }
-      
-      if(ret != BUFFER_SEG_SIZE || gzeof(in))
-         eof_flag = 1;
+
+      if(s->eof_flag)
+         continue;
+
+      if(s->ahead)
+         ret = ahead_read(s->ahead, s->buffer + s->bufseg * BUFFER_SEG_SIZE);
+      else
+         ret = bsm_fill(s, s->buffer + s->bufseg * BUFFER_SEG_SIZE,
+                        BUFFER_SEG_SIZE);
+      if(ret == -1) {
+         s->eof_flag = 1;
+         return 0;
+      }
+
+      s->o_read += ret;
+      if(ret != BUFFER_SEG_SIZE)
+         s->eof_flag = 1;
    }
    
    return 1;
 }
 
-void bsm_reset(gzFile *in)
+/**
+ * Rewind a stream to its beginning.
+ * @param s stream
+ */
+void bsm_reset(bsm_stream_t * s)
+{
+   ahead_t *ahead = s->ahead;
+
+   ahead_stop(ahead);
+   zidx_end(s->zin);
+   s->zin = NULL;
+   if (s->uring)
+      uring_seek(s->uring, 0);
+   else
+      gzseek(s->in, 0, SEEK_SET);
+   s->bufptr = 0;
+   s->bufseg = BUFFER_SEGMENTS - 1;
+   s->eof_flag = 0;
+   s->o_pos = s->o_read = 0;
+   s->str_left = 0;
+   s->chunk = 0;
+   s->skipped = 0;
+   s->windowed = 0;
+   s->next = 0;
+   s->ahead = ahead ? ahead_start(bsm_fill, s, BUFFER_SEG_SIZE) : NULL;
+}
+
+/**
+ * Copy the strings of an exec argument or environment token from the
+ * stream to the buffer. Copying stops when all strings have been copied or
+ * the buffer is full. In the latter case the remaining strings are
+ * returned by the next calls of bsm_read().
+ * @param s stream
+ * @param buf buffer
+ * @param off offset in buffer
+ * @param len length of buffer
+ * @return number of bytes in buffer
+ */
+static int bsm_read_strings(bsm_stream_t * s, char *buf, int off, int len)
+{
+   int n;
+
+   while (s->str_left && off < len) {
+      if (!check_buffer(s, s->bufptr))
+	 break;
+
+      n = BUFFER_SEG_SIZE - s->bufptr % BUFFER_SEG_SIZE;
+      if (n > s->o_read - s->o_pos)
+	 n = s->o_read - s->o_pos;
+      if (n > len - off)
+	 n = len - off;
+      if (n <= 0)
+	 break;
+
+      n = kern_skip_nuls(s->buffer + s->bufptr, n, &s->str_left);
+      memcpy(buf + off, s->buffer + s->bufptr, n);
+
+      s->bufptr = (s->bufptr + n) % BUFFER_SIZE;
+      s->o_pos += n;
+      off += n;
+   }
+
+   /*
+    * A token truncated by the end of the stream is not continued.
+    */
+   if (bsm_eof(s))
+      s->str_left = 0;
+
+   if (s->str_left)
+      s->chunk |= BSM_CHUNK_MORE;
+
+   return off;
+}
+
+/**
+ * Skip bytes of the stream.
+ * @param s stream
+ * @param n number of bytes
+ */
+static void bsm_skip(bsm_stream_t * s, int n)
 {
-   gzseek(in, 0, SEEK_SET);
-   bufptr = 0;
-   bufseg = BUFFER_SEGMENTS - 1;
-   eof_flag = 0;
+   s->bufptr = (s->bufptr + n) % BUFFER_SIZE;
+   s->o_pos += n;
+}
+
+/**
+ * Skip a whole record using the byte count of its header. The stream has
+ * to be positioned at the header. Records may exceed the ring buffer, so
+ * they are skipped segment by segment.
+ * @param s stream
+ * @param count byte count of the record
+ */
+static void bsm_skip_record(bsm_stream_t * s, uint32_t count)
+{
+   int n;
+
+   while (count > 0 && !bsm_eof(s)) {
+      n = count < BUFFER_SEG_SIZE ? count : BUFFER_SEG_SIZE;
+      check_buffer(s, (s->bufptr + n) % BUFFER_SIZE);
+      bsm_skip(s, n);
+      count -= n;
+   }
+}
+
+/**
+ * Decode the time of a record from its header. The time field follows the
+ * host address in extended headers and has 8 bytes in 64 bit headers.
+ * @param buf buffer containing a header token
+ * @return time of record in seconds
+ */
+uint64_t bsm_time(uchar_t * buf)
+{
+   int pos = 10;
+
+   if (buf[0] == AUT_HEADER32_EX || buf[0] == AUT_HEADER64_EX)
+      pos = 14 + (field_get32(buf + 10) == AU_IPv6 ? 16 : 4);
+
+   if (buf[0] == AUT_HEADER64 || buf[0] == AUT_HEADER64_EX)
+      return field_get64(buf + pos);
+
+   return field_get32(buf + pos);
+}
+
+/**
+ * Find the subject of the record at the current position without
+ * consuming any data. The tokens of the record are walked using their
+ * sizes. Records larger than BSM_TOKEN_MAX can't be walked.
+ * @param s stream positioned at a header
+ * @param auid receives the audit user ID of the subject
+ * @return 1 if a subject has been found, 0 if the record has no subject
+ * or -1 if the record is too large to be walked
+ */
+int bsm_subject(bsm_stream_t * s, uint32_t * auid)
+{
+   int bufptr = s->bufptr, quiet = s->quiet, size, ret = 0;
+   uint32_t count, pos = 0;
+   uchar_t id;
+
+   count = read_int(s, 1);
+   if (count > BSM_TOKEN_MAX)
+      return -1;
+
+   s->quiet = 1;
+   while (pos < count) {
+      s->bufptr = (bufptr + pos) % BUFFER_SIZE;
+      id = read_char(s, 0);
+      if (id == AUT_SUBJECT32 || id == AUT_SUBJECT64 ||
+	  id == AUT_SUBJECT32_EX || id == AUT_SUBJECT64_EX) {
+	 *auid = read_int(s, 1);
+	 ret = 1;
+	 break;
+      }
+
+      if ((size = get_token_size(s, id)) <= 0)
+	 break;
+      pos += size;
+   }
+
+   s->bufptr = bufptr;
+   s->quiet = quiet;
+   return ret;
+}
+
+/**
+ * Check whether the stream is positioned at a plausible record header.
+ * The byte count of the header must point to a trailer with the trailer
+ * magic and the same byte count. Records larger than BSM_TOKEN_MAX can't
+ * be checked and are rejected.
+ * @param s stream
+ * @return 1 if the header is plausible or 0 otherwise
+ */
+static int bsm_valid_header(bsm_stream_t * s)
+{
+   uint32_t count, min;
+
+   min = s->buffer[s->bufptr] == AUT_HEADER32 ? 18 : 26;
+   count = read_int(s, 1);
+   if (count < min + 7 || count > BSM_TOKEN_MAX)
+      return 0;
+
+   if (read_char(s, count - 7) != AUT_TRAILER ||
+       read_short(s, count - 6) != AUT_TRAILER_MAGIC ||
+       read_int(s, count - 4) != count)
+      return 0;
+
+   /*
+    * Near the end of the stream the ring buffer may hold stale data.
+    */
+   return s->o_pos + count <= s->o_read;
+}
+
+/**
+ * Decode the time of the record whose header is at the current position.
+ * @param s stream positioned at a header
+ * @param size size of the header token
+ * @return time of record in seconds
+ */
+static uint64_t bsm_read_time(bsm_stream_t * s, int size)
+{
+   uchar_t buf[64];
+
+   read_bytes(s, 0, buf, size < sizeof(buf) ? size : sizeof(buf));
+   return bsm_time(buf);
+}
+
+/**
+ * Check a record header in a mapped audit trail. The header must be
+ * complete and its byte count must point to a matching trailer, as in
+ * bsm_valid_header().
+ * @param map mapped trail
+ * @param size size of trail
+ * @param p position of header
+ * @return byte count of the record or 0 if the header is not valid
+ */
+static uint32_t bsm_map_header(uchar_t * map, long long size, long long p)
+{
+   uchar_t *h = map + p;
+   uint32_t count, min;
+
+   switch (h[0]) {
+   case AUT_HEADER32:
+      min = 18;
+      break;
+   case AUT_HEADER64:
+      min = 26;
+      break;
+   case AUT_HEADER32_EX:
+   case AUT_HEADER64_EX:
+      if (size - p < 14)
+	 return 0;
+      min = 14 + (field_get32(h + 10) == AU_IPv6 ? 16 : 4);
+      min += h[0] == AUT_HEADER32_EX ? 8 : 16;
+      break;
+   default:
+      return 0;
+   }
+
+   if (size - p < min + 7)
+      return 0;
+
+   count = field_get32(h + 1);
+   if (count < min + 7 || count > size - p)
+      return 0;
+
+   h += count - 7;
+   if (h[0] != AUT_TRAILER || field_get16(h + 1) != AUT_TRAILER_MAGIC ||
+       field_get32(h + 3) != count)
+      return 0;
+
+   return count;
+}
+
+/**
+ * Find the next valid record header in a mapped audit trail.
+ * @param map mapped trail
+ * @param size size of trail
+ * @param p position to start at
+ * @return position of header or size if there is none
+ */
+static long long bsm_map_next(uchar_t * map, long long size, long long p)
+{
+   for (; p < size; p++)
+      if (bsm_map_header(map, size, p))
+	 break;
+
+   return p;
+}
+
+/**
+ * Reposition a stream at an offset of the uncompressed data. Compressed
+ * files are accessed through their gzip index, which is built on first
+ * use.
+ * @param s stream
+ * @param offset offset in uncompressed data
+ * @return 1 on success or 0 on failure
+ */
+static int bsm_seek(bsm_stream_t * s, long long offset)
+{
+   zidx_reader_t *zin = NULL;
+   ahead_t *ahead = s->ahead;
+
+   if (!bsm_direct(s)) {
+      if (!s->zidx && !(s->zidx = zidx_open(s->name, s->fd, 1)))
+	 return 0;
+      if (!(zin = zidx_seek(s->zidx, s->fd, offset)))
+	 return 0;
+   }
+
+   /*
+    * Data read ahead is discarded.
+    */
+   ahead_stop(ahead);
+   s->ahead = NULL;
+
+   if (zin) {
+      zidx_end(s->zin);
+      s->zin = zin;
+   } else if (s->uring ? !uring_seek(s->uring, offset) :
+	      gzseek(s->in, offset, SEEK_SET) != offset) {
+      err_msg("Could not seek in %s", s->name);
+      s->eof_flag = 1;
+      s->o_read = s->o_pos;
+      return 0;
+   }
+
+   s->bufptr = 0;
+   s->bufseg = BUFFER_SEGMENTS - 1;
+   s->eof_flag = 0;
+   s->o_pos = s->o_read = offset;
+   s->str_left = 0;
+   s->next = 0;
+
+   if (ahead)
+      s->ahead = ahead_start(bsm_fill, s, BUFFER_SEG_SIZE);
+   return 1;
+}
+
+/**
+ * Locate the first record inside the time window of an uncompressed file.
+ * Record times increase monotonically within a trail, so the record is
+ * located by a binary search over the mapped file. Each probe
+ * resynchronizes to the next valid record header.
+ * @param s stream positioned at the first record header
+ * @return position of record or -1 if the file can't be searched
+ */
+static long long bsm_window_map(bsm_stream_t * s)
+{
+   long long lo = s->o_pos, hi, mid, p;
+   struct stat st;
+   uchar_t *map;
+
+   if (fstat(s->fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= lo)
+      return -1;
+
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, s->fd, 0);
+   if (map == MAP_FAILED)
+      return -1;
+   madvise(map, st.st_size, MADV_RANDOM);
+
+   /*
+    * The first record inside the window lies at or after lo. A probe
+    * past the window bounds the search from above, a probe before the
+    * window moves lo past its record.
+    */
+   hi = st.st_size;
+   while (hi - lo > BUFFER_SEG_SIZE) {
+      mid = lo + (hi - lo) / 2;
+      p = bsm_map_next(map, st.st_size, mid);
+      if (p == st.st_size || bsm_time(map + p) >= time_from)
+	 hi = mid;
+      else
+	 lo = p + bsm_map_header(map, st.st_size, p);
+   }
+
+   p = bsm_map_next(map, st.st_size, lo);
+   while (p < st.st_size && bsm_time(map + p) < time_from) {
+      lo = p + bsm_map_header(map, st.st_size, p);
+      p = bsm_map_next(map, st.st_size, lo);
+   }
+
+   /*
+    * Without records in the window the stream continues after the last
+    * record, so that a final file token is kept.
+    */
+   if (p == st.st_size)
+      p = lo;
+
+   munmap(map, st.st_size);
+   return p;
+}
+
+/**
+ * Locate a record shortly before the time window of a compressed file.
+ * The access points of the gzip index are searched for the last one whose
+ * first record lies before the window. Records between this record and
+ * the window are skipped when reading.
+ * @param s stream positioned at the first record header
+ * @return position of record or -1 if there is no such record
+ */
+static long long bsm_window_zidx(bsm_stream_t * s)
+{
+   unsigned int lo = 0, hi, mid;
+   long long p, best = -1;
+   zidx_reader_t *r;
+   uchar_t *buf;
+   int n, len;
+
+   if (!s->zidx && !(s->zidx = zidx_open(s->name, s->fd, 1)))
+      return -1;
+
+   if (!(buf = malloc(BUFFER_SIZE))) {
+      err_msg("Failed to allocate memory");
+      return -1;
+   }
+
+   hi = s->zidx->num;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+
+      /*
+       * Probe the first valid record header after the point. Probes
+       * without a header are treated like probes past the window.
+       */
+      p = -1;
+      if ((r = zidx_seek(s->zidx, s->fd, s->zidx->points[mid].out))) {
+	 for (len = 0; len < BUFFER_SIZE; len += n)
+	    if ((n = zidx_read(r, buf + len, BUFFER_SIZE - len)) <= 0)
+	       break;
+	 zidx_end(r);
+
+	 p = bsm_map_next(buf, len, 0);
+	 if (p == len || bsm_time(buf + p) >= time_from)
+	    p = -1;
+      }
+
+      if (p < 0) {
+	 hi = mid;
+	 continue;
+      }
+
+      p += s->zidx->points[mid].out;
+      if (p > s->o_pos)
+	 best = p;
+      lo = mid + 1;
+   }
+
+   free(buf);
+   return best;
+}
+
+/**
+ * Position a stream near the first record inside the time window. The
+ * search is only possible for regular files, other streams are left
+ * untouched and their records before the window are skipped one by one.
+ * @param s stream positioned at the first record header
+ * @return 1 if the stream has been repositioned or 0 otherwise
+ */
+static int bsm_seek_window(bsm_stream_t * s)
+{
+   long long p;
+
+   s->windowed = 1;
+   p = bsm_direct(s) ? bsm_window_map(s) : bsm_window_zidx(s);
+
+   return p >= 0 && bsm_seek(s, p);
+}
+
+/**
+ * Resynchronize a corrupt stream. The stream is searched for the next
+ * record header that passes bsm_valid_header(), starting after the
+ * current byte. The skipped range is reported and counted.
+ * @param s stream
+ */
+static void bsm_resync(bsm_stream_t * s)
+{
+   long start = s->o_pos;
+   int n, m;
+
+   bsm_skip(s, 1);
+   for (;;) {
+      check_buffer(s, s->bufptr);
+      if (bsm_eof(s))
+	 break;
+
+      /*
+       * Search the contiguous part of the segment for a header ID.
+       */
+      n = BUFFER_SEG_SIZE - s->bufptr % BUFFER_SEG_SIZE;
+      if (n > s->o_read - s->o_pos)
+	 n = s->o_read - s->o_pos;
+
+      m = kern_find(s->buffer + s->bufptr, n, AUT_HEADER32, AUT_HEADER64);
+      bsm_skip(s, m);
+      if (m == n)
+	 continue;
+
+      if (bsm_valid_header(s))
+	 break;
+      bsm_skip(s, 1);
+   }
+
+   s->skipped += s->o_pos - start;
+   if (!s->quiet)
+      err_msg("Skipped %ld corrupt bytes at %ld in %s", s->o_pos - start,
+	      start, s->name);
+}
+
+/**
+ * Position the stream at the next token to be read. Records outside the
+ * time window or rejected by the filter are skipped as a whole. The
+ * stream ends at the first record after the window. If the stream is
+ * corrupt, the function fails unless resynchronization is enabled. The
+ * position is kept until the token is consumed, so that it can be peeked
+ * at before.
+ * @param s stream
+ * @param len maximum size of token
+ * @return size of token, 0 at the end of the stream or -1 on failure
+ */
+static int bsm_next(bsm_stream_t * s, int len)
+{
+   uchar_t token_id;
+   uint64_t time;
+   int size;
+
+   if (s->next && s->next <= len)
+      return s->next;
+
+   for (;;) {
+      check_buffer(s, s->bufptr);
+      if (bsm_eof(s))
+	 return 0;
+
+      token_id = s->buffer[s->bufptr];
+      s->trace[s->trace_ptr] = token_id;
+      s->trace_ptr = (s->trace_ptr + 1) % TRACE_SIZE;
+
+      if (token_id == AUT_EXEC_ARGS || token_id == AUT_EXEC_ENV)
+	 size = 1 + 4;
+      else
+	 size = get_token_size(s, token_id);
+
+      if (size > 0 && (token_id == AUT_HEADER32 ||
+		       token_id == AUT_HEADER32_EX ||
+		       token_id == AUT_HEADER64 ||
+		       token_id == AUT_HEADER64_EX) &&
+	  read_int(s, 1) >= size) {
+	 time = bsm_read_time(s, size);
+
+	 if (time < time_from && !s->windowed && bsm_seek_window(s))
+	    continue;
+
+	 if (time > time_to) {
+	    s->eof_flag = 1;
+	    s->o_read = s->o_pos;
+	    return 0;
+	 }
+
+	 if (time < time_from || !filter_record(s)) {
+	    bsm_skip_record(s, read_int(s, 1));
+	    continue;
+	 }
+      }
+
+      if (size >= 0 && size <= len)
+	 break;
+
+      if (size > len && !s->quiet)
+	 err_msg("Buffer of size %d to small for event of size %d.",
+		 len, size);
+
+      if (!resync)
+	 return -1;
+
+      bsm_resync(s);
+   }
+
+   s->next = size;
+   return size;
+}
+
+/**
+ * Peek at the next token of the stream without consuming it.
+ * @param s stream
+ * @param time receives the time of the record if the token is a header
+ * @return 1 if the token is a header, 0 if it is another token and -1 at
+ * the end of the stream or on failure
+ */
+int bsm_peek(bsm_stream_t * s, uint64_t * time)
+{
+   uchar_t token_id;
+   int size;
+
+   if (s->str_left)
+      return 0;
+
+   if ((size = bsm_next(s, BSM_TOKEN_MAX)) <= 0)
+      return -1;
+
+   token_id = s->buffer[s->bufptr];
+   if (token_id != AUT_HEADER32 && token_id != AUT_HEADER32_EX &&
+       token_id != AUT_HEADER64 && token_id != AUT_HEADER64_EX)
+      return 0;
+
+   *time = bsm_read_time(s, size);
+   return 1;
 }
 
 /**
@@ -371,93 +1192,411 @@ void bsm_reset(gzFile *in)
  * len initially contains the length of the given buffer. If the buffer
  * is too small the function aborts, otherwise the token is read into
  * the buffer and the actual token size is written into the len argument.
- * @param in stream
+ * At the end of the stream the token size is 0.
+ *
+ * Exec argument and environment tokens are not limited in size and are
+ * therefore returned in chunks of at most len bytes. The flags in
+ * s->chunk tell whether the buffer continues the previous token and
+ * whether the token continues in the next buffer.
+ * @param s stream
  * @param buf buffer for token
  * @param len length of buffer
  * @return 1 on success or 0 on failure
  */
-int bsm_read(gzFile * in, char *buf, int *len)
+int bsm_read(bsm_stream_t * s, char *buf, int *len)
 {
    uchar_t token_id;
-   int size, i;
+   int size, max, i;
 
-   if(bsm_eof(in)) 
+   s->chunk = 0;
+   if (s->str_left) {
+      s->chunk = BSM_CHUNK_CONT;
+      *len = bsm_read_strings(s, buf, 0, *len);
       return 1;
-   
-   check_buffer(in, bufptr);
-   token_id = buffer[bufptr];
-   trace[trace_ptr] = token_id;
-   trace_ptr = (trace_ptr + 1) % TRACE_SIZE;
-   size = get_token_size(in, token_id);
-
-   if (size > *len) {
-      err_msg("Buffer of size %d to small for event of size %d.",
-	      *len, size);
+   }
+
+   max = *len;
+   size = bsm_next(s, max);
+   if (size < 0)
       return 0;
+
+   if (size == 0) {
+      *len = 0;
+      return 1;
    }
+
+   s->next = 0;
+   token_id = s->buffer[s->bufptr];
+
+   if (token_id == AUT_EXEC_ARGS || token_id == AUT_EXEC_ENV)
+      s->str_left = read_int(s, 1);
    
    for(i = 0; i < size; i++) {
-      check_buffer(in, bufptr);
-      buf[i] = buffer[bufptr];
-      bufptr = (bufptr + 1) % BUFFER_SIZE;
+      check_buffer(s, s->bufptr);
+      buf[i] = s->buffer[s->bufptr];
+      s->bufptr = (s->bufptr + 1) % BUFFER_SIZE;
    }
+   s->o_pos += size;
    *len = size;
 
+   if (token_id == AUT_EXEC_ARGS || token_id == AUT_EXEC_ENV)
+      *len = bsm_read_strings(s, buf, size, max);
+
    return 1;
 }
 
 /**
- * Write a token from the buffer to a stream
- * @param zout compressed stream
- * @param out stream
- * @param buf buffer containing token
- * @param len length of token
+ * Open an output stream on a file descriptor. With a negative descriptor
+ * the stream is opened without file, which is attached by bsm_out_file().
+ * @param o output stream
+ * @param fd file descriptor or -1
+ * @param mode OUT_STDIO, OUT_ZLIB, OUT_MAP or OUT_PLAIN, i.e. a compress
+ * flag selects between the first two
+ * @param format output format, EMIT_BSM for binary tokens
+ * @return 1 on success or 0 on failure
+ */
+int bsm_out_open(bsm_out_t * o, int fd, int mode, int format)
+{
+   o->fd = -1;
+   o->bytes = 0;
+   o->offset = 0;
+   o->zout = NULL;
+   o->out = NULL;
+   o->mout = NULL;
+   o->uring = NULL;
+   o->emit = NULL;
+   o->cols = NULL;
+   o->idx = NULL;
+   o->part = NULL;
+   o->rot = NULL;
+   o->rec = NULL;
+   o->rec_len = o->rec_size = 0;
+   o->rec_open = 0;
+   o->rec_stream = 0;
+   o->rec_time = 0;
+   o->streaming = 0;
+   o->dropping = 0;
+
+   if (format != EMIT_BSM && !(o->emit = emit_create(format)))
+      return 0;
+
+   return fd < 0 || bsm_out_file(o, fd, mode);
+}
+
+/**
+ * Attach a file to an output stream. The stream must not have a file
+ * attached, e.g. it has been opened without one or the file of a rotated
+ * stream has been detached.
+ * @param o output stream
+ * @param fd file descriptor
+ * @param mode OUT_STDIO, OUT_ZLIB, OUT_MAP or OUT_PLAIN. If the file can't
+ * be mapped, it is written through stdio. Regular files written through
+ * stdio are written through io_uring if possible, except with OUT_PLAIN.
  * @return 1 on success or 0 on failure
  */
-int bsm_write(gzFile * zout, FILE * out, char *buf, int len)
+int bsm_out_file(bsm_out_t * o, int fd, int mode)
+{
+   o->fd = fd;
+   o->bytes = 0;
+   o->offset = 0;
+   o->zout = NULL;
+   o->out = NULL;
+   o->mout = NULL;
+   o->uring = NULL;
+
+   if (mode == OUT_MAP)
+      o->mout = mout_open(fd);
+   else if (mode == OUT_STDIO)
+      o->uring = uring_writer(fd);
+
+   if (mode == OUT_ZLIB)
+      o->zout = gzdopen(fd, "wb9");
+   else if (!o->mout && !o->uring)
+      o->out = fdopen(fd, "wb");
+
+   return o->zout || o->out || o->mout || o->uring;
+}
+
+/**
+ * Flush and close an output stream.
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+int bsm_out_close(bsm_out_t * o)
+{
+   int ret = 1;
+
+   if (o->rec_open)
+      ret = bsm_abort(o);
+   free(o->rec);
+
+   if (o->part && !part_close(o->part))
+      ret = 0;
+
+   if (o->emit) {
+      if (!emit_finish(o))
+	 ret = 0;
+      free(o->emit);
+   }
+
+   if (o->cols && !cols_close(o->cols))
+      ret = 0;
+
+   if (o->rot && !rot_close(o))
+      ret = 0;
+
+   if (o->idx && !idx_close(o))
+      ret = 0;
+
+   if (o->zout && gzclose(o->zout) != Z_OK) {
+      err_msg("gzclose");
+      ret = 0;
+   }
+
+   if (o->out && fclose(o->out)) {
+      err_msg("fclose");
+      ret = 0;
+   }
+
+   if (o->mout && !mout_close(o->mout))
+      ret = 0;
+
+   if (o->uring && !uring_close(o->uring))
+      ret = 0;
+
+   return ret;
+}
+
+/**
+ * Write data to the underlying file of a stream, bypassing the assembly of
+ * records. The stream is flushed after every BUFFER_FLUSH bytes. A rotated
+ * stream opens its first file with the first data.
+ * @param o output stream
+ * @param buf buffer containing data
+ * @param len length of data
+ * @return 1 on success or 0 on failure
+ */
+int bsm_put(bsm_out_t * o, char *buf, int len)
 {
 
    if (len == 0)
       return 1;
 
-   if (zout) {
-      if (gzwrite(zout, buf, len) != len) {
-	 err_msg("gzwrite: %s", gzerror(zout, &errnum));
+   if (o->rot && o->fd < 0 && !rot_first(o, (uchar_t *) buf))
+      return 0;
+
+   if (o->zout) {
+      if (gzwrite(o->zout, buf, len) != len) {
+	 err_msg("gzwrite: %s", gzerror(o->zout, &errnum));
 	 return 0;
       }
    }
 
-   if (out) {
-      if (fwrite(buf, len, 1, out) != 1) {
+   if (o->out) {
+      if (fwrite(buf, len, 1, o->out) != 1) {
 	 err_msg("fwrite");
 	 return 0;
       }
    }
 
+   if (o->mout && !mout_write(o->mout, buf, len))
+      return 0;
+
+   if (o->uring && !uring_write(o->uring, buf, len))
+      return 0;
+
+   o->bytes += len;
+   o->offset += len;
+   if (o->bytes >= BUFFER_FLUSH) {
+      if (o->out)
+	 fflush(o->out);
+
+      if (o->zout)
+	 gzflush(o->zout, Z_SYNC_FLUSH);
+	 
+      o->bytes = 0;
+   }
+
    return 1;
 }
 
-int bsm_check(gzFile *in, char *filename) 
+/**
+ * Account a record that is about to be written to a rotated or indexed
+ * output.
+ * @param o output stream
+ * @param time pseudonymized time of the record
+ * @return 1 on success or 0 on failure
+ */
+int bsm_account(bsm_out_t * o, uint64_t time)
 {
-   int len;
-   char buf[128];   
+   if (o->rot && !rot_record(o, time))
+      return 0;
 
-   len = 128;
+   if (o->idx && !idx_record(o, time))
+      return 0;
 
-   bsm_read(in, buf, &len);  
+   return 1;
+}
 
-   gzseek(in, 0, SEEK_SET);
-   if (buf[0] != AUT_OTHER_FILE32 && buf[0] != AUT_OTHER_FILE64) {
-      err_msg("Skipping %s, not a Solaris BSM audit log", filename);
+/**
+ * Write an assembled record to the underlying file or to its partition.
+ * @param o output stream
+ * @param len length of record
+ * @return 1 on success or 0 on failure
+ */
+static int bsm_put_record(bsm_out_t * o, int len)
+{
+   if (!bsm_account(o, o->rec_time))
+      return 0;
+
+   if (o->part)
+      return part_record(o->part, o->rec, len);
+
+   return bsm_put(o, o->rec, len);
+}
+
+/**
+ * Write a token from the buffer to a stream. Between bsm_begin() and
+ * bsm_end() the token is appended to the assembled record instead. If
+ * the record may be written before its end, it is written as soon as it
+ * exceeds BSM_TOKEN_MAX and the rest of it is streamed.
+ * @param o output stream
+ * @param buf buffer containing token
+ * @param len length of token
+ * @return 1 on success or 0 on failure
+ */
+int bsm_write(bsm_out_t * o, char *buf, int len)
+{
+   char *tmp;
+   int size;
+
+   if (!o->rec_open)
+      return o->part ? part_broadcast(o->part, buf, len) :
+	  bsm_put(o, buf, len);
+
+   if (o->rec_stream && o->rec_len + len > BSM_TOKEN_MAX) {
+      o->rec_open = 0;
+      o->streaming = 1;
+      return bsm_put_record(o, o->rec_len) && bsm_put(o, buf, len);
+   }
+
+   if (len > INT_MAX - o->rec_len) {
+      err_msg("Record too large to be assembled");
+      return 0;
+   }
+
+   if (o->rec_len + len > o->rec_size) {
+      size = o->rec_size ? o->rec_size : BUFFER_SEG_SIZE;
+      while (size < o->rec_len + len)
+	 size = size > INT_MAX / 2 ? INT_MAX : size * 2;
+
+      if (!(tmp = realloc(o->rec, size))) {
+	 err_msg("Failed to allocate memory");
+	 return 0;
+      }
+      o->rec = tmp;
+      o->rec_size = size;
+   }
+
+   memcpy(o->rec + o->rec_len, buf, len);
+   o->rec_len += len;
+   return 1;
+}
+
+/**
+ * Finish an assembled record that lacks its trailer. With resynchronization
+ * the record has been cut off by corrupt data and is discarded, otherwise
+ * it is written unpatched.
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+int bsm_abort(bsm_out_t * o)
+{
+   /*
+    * A streamed record has partly been written already.
+    */
+   if (o->streaming && resync)
+      err_msg("Kept record of more than %d bytes cut off by corrupt data",
+	      BSM_TOKEN_MAX);
+   o->streaming = 0;
+
+   if (!o->rec_open)
+      return 1;
+
+   o->rec_open = 0;
+   return resync || bsm_put_record(o, o->rec_len);
+}
+
+/**
+ * Start to assemble a record. The following tokens are collected until
+ * bsm_end() is called, so that the byte count of the record can be
+ * patched. A record assembled before is finished by bsm_abort().
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+int bsm_begin(bsm_out_t * o)
+{
+   int ret = bsm_abort(o);
+
+   o->rec_open = 1;
+   o->rec_len = 0;
+   return ret;
+}
+
+/**
+ * Finish an assembled record and write it to the stream. The byte counts
+ * of the header and the trailer are set to the size of the assembled
+ * record, which differs from the original size if tokens have been
+ * dropped.
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+int bsm_end(bsm_out_t * o)
+{
+   uchar_t *rec = (uchar_t *) o->rec;
+   int len = o->rec_len;
+
+   o->streaming = 0;
+   if (!o->rec_open)
+      return 1;
+
+   o->rec_open = 0;
+   if (len >= 5 + 7 && rec[len - 7] == AUT_TRAILER) {
+      field_put32(rec + 1, len);
+      field_put32(rec + len - 4, len);
+   }
+
+   return bsm_put_record(o, len);
+}
+
+/**
+ * Check if the stream contains a Solaris BSM audit trail. The first token
+ * is only peeked at and not consumed, so that the check also works on
+ * streams that can't be rewound.
+ * @param s stream
+ * @return 1 if the stream is an audit trail or 0 otherwise
+ */
+int bsm_check(bsm_stream_t * s) 
+{
+   check_buffer(s, s->bufptr);
+   if (bsm_eof(s) || (s->buffer[s->bufptr] != AUT_OTHER_FILE32 &&
+                      s->buffer[s->bufptr] != AUT_OTHER_FILE64)) {
+      err_msg("Skipping %s, not a Solaris BSM audit log", s->name);
       return 0;
    }
 
    return 1;
 }
 
-int bsm_eof(gzFile *in) 
+/**
+ * Check for the end of a stream. The end is reached if the underlying
+ * file has been read completely and all buffered bytes are consumed.
+ * @param s stream
+ * @return 1 at the end of the stream or 0 otherwise
+ */
+int bsm_eof(bsm_stream_t * s) 
 {
-   if(gzeof(in) || eof_flag)
+   if(s->eof_flag && s->o_pos >= s->o_read)
       return 1;
       
    return 0;   
@@ -29,14 +29,112 @@
 #ifndef _BSM_H
 #define _BSM_H
 
-#define BUFFER_SIZE             32768
-#define BUFFER_SEGMENTS         4
+#define BUFFER_SIZE             196608
+#define BUFFER_SEGMENTS         6
 #define BUFFER_SEG_SIZE         (BUFFER_SIZE / BUFFER_SEGMENTS)
 #define TRACE_SIZE              5
-int bsm_read(gzFile *in, char *buf, int *len);
-int bsm_write(gzFile *zout, FILE *out, char *buf, int len);
-void bsm_reset(gzFile *in);
-int bsm_check(gzFile *in, char *filename);
-int bsm_eof(gzFile *in);
+#define BUFFER_FLUSH            5000000
+
+/*
+ * Maximum size of a token that is read as a whole. Sizing a token may look
+ * ahead BUFFER_SEGMENTS - 2 segments, which covers all tokens with 16 bit
+ * lengths. Exec argument and environment tokens are read in chunks.
+ */
+#define BSM_TOKEN_MAX           ((BUFFER_SEGMENTS - 2) * BUFFER_SEG_SIZE)
+
+#define OUT_STDIO               0	/**< Output buffered by stdio */
+#define OUT_ZLIB                1	/**< Output compressed by zlib */
+#define OUT_MAP                 2	/**< Output copied into mapped file */
+#define OUT_PLAIN               3	/**< Output buffered by stdio only */
+
+#define BSM_CHUNK_CONT          1	/**< Buffer continues a token */
+#define BSM_CHUNK_MORE          2	/**< Token continues in next buffer */
+
+/**
+ * Input stream of BSM tokens. Tokens are read through a ring buffer of
+ * BUFFER_SEGMENTS segments, which allows to look ahead when computing the
+ * size of a token. Exec argument and environment tokens are streamed in
+ * chunks, chunk holds the BSM_CHUNK flags of the last chunk read.
+ */
+typedef struct {
+   gzFile in;			     /**< Underlying (compressed) file */
+   int fd;			     /**< File descriptor of file */
+   char *name;			     /**< Name used in messages */
+   uchar_t buffer[BUFFER_SIZE];	     /**< Ring buffer */
+   int bufptr;			     /**< Read position in ring buffer */
+   int bufseg;			     /**< Most recently read segment */
+   int eof_flag;		     /**< Underlying file is exhausted */
+   long o_pos;			     /**< Number of consumed bytes */
+   long o_read;			     /**< Number of bytes read from file */
+   uchar_t trace[TRACE_SIZE];	     /**< Trace of recent token IDs */
+   uchar_t trace_ptr;		     /**< Position in trace */
+   unsigned int str_left;	     /**< Strings left in streamed token */
+   int chunk;			     /**< Flags of last chunk */
+   int quiet;			     /**< Don't report corrupt data */
+   long skipped;		     /**< Bytes skipped by resynchronization */
+   int windowed;		     /**< Start of time window was searched */
+   struct s_zidx *zidx;		     /**< Index of gzip file or NULL */
+   struct s_zidx_reader *zin;	     /**< Reader of repositioned gzip file */
+   struct s_ahead *ahead;	     /**< Read-ahead thread or NULL */
+   struct s_uring *uring;	     /**< Queued reads of file or NULL */
+   int next;			     /**< Size of peeked token or 0 */
+   int direct;			     /**< File is uncompressed, -1 unknown */
+} bsm_stream_t;
+
+/**
+ * Output stream of BSM tokens. One of zout, out, mout and uring is used.
+ * Records can be assembled in memory, so that their byte counts can be
+ * patched, or be formatted as text by an emitter, or be written as rows of
+ * columns.
+ */
+typedef struct {
+   gzFile zout;			     /**< Compressed output */
+   FILE *out;			     /**< Uncompressed output */
+   struct s_mout *mout;		     /**< Memory-mapped output */
+   struct s_uring *uring;	     /**< Queued writes of output */
+   int fd;			     /**< Underlying file descriptor */
+   long bytes;			     /**< Bytes written since last flush */
+   long long offset;		     /**< Uncompressed bytes written */
+   char *rec;			     /**< Record being assembled */
+   int rec_len;			     /**< Length of assembled record */
+   int rec_size;		     /**< Size of record buffer */
+   int rec_open;		     /**< A record is being assembled */
+   int rec_stream;		     /**< Record may be written before its end */
+   uint64_t rec_time;		     /**< Time of assembled record */
+   int streaming;		     /**< Rest of a large record is streamed */
+   int dropping;		     /**< Rest of streamed token is dropped */
+   struct s_emit *emit;		     /**< Emitter for text output or NULL */
+   struct s_cols *cols;		     /**< Columnar writer or NULL */
+   struct s_idx *idx;		     /**< Sidecar index or NULL */
+   struct s_part *part;		     /**< Partitioned output or NULL */
+   struct s_rot *rot;		     /**< Rotated output or NULL */
+} bsm_out_t;
+
+bsm_stream_t *bsm_open(char *name);
+bsm_stream_t *bsm_dopen(int fd, char *name);
+void bsm_close(bsm_stream_t *s);
+int bsm_read(bsm_stream_t *s, char *buf, int *len);
+int bsm_peek(bsm_stream_t *s, uint64_t *time);
+int bsm_ahead(bsm_stream_t *s);
+long long bsm_size(bsm_stream_t *s);
+void bsm_reset(bsm_stream_t *s);
+int bsm_check(bsm_stream_t *s);
+int bsm_eof(bsm_stream_t *s);
+int bsm_subject(bsm_stream_t *s, uint32_t *auid);
+uint64_t bsm_time(uchar_t *buf);
+
+uchar_t read_char(bsm_stream_t *s, int pos);
+ushort_t read_short(bsm_stream_t *s, int pos);
+uint32_t read_int(bsm_stream_t *s, int pos);
+
+int bsm_out_open(bsm_out_t *o, int fd, int mode, int format);
+int bsm_out_file(bsm_out_t *o, int fd, int mode);
+int bsm_out_close(bsm_out_t *o);
+int bsm_put(bsm_out_t *o, char *buf, int len);
+int bsm_write(bsm_out_t *o, char *buf, int len);
+int bsm_account(bsm_out_t *o, uint64_t time);
+int bsm_begin(bsm_out_t *o);
+int bsm_abort(bsm_out_t *o);
+int bsm_end(bsm_out_t *o);
 
 #endif				/* _BSM_H */
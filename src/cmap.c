@@ -0,0 +1,354 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file cmap.c Concurrent mapping table.
+ * The mappings of bsmpseu are insert-once: a key is either absent or maps
+ * forever to the same pseudonym. This table exploits this property. Readers
+ * walk the bucket lists without any locks and new entries are published by
+ * a single compare-and-swap on the head of a bucket. If two threads race to
+ * insert the same key, the loser discards its entry and both threads
+ * continue with the data of the winner.
+ *
+ * Entries can be removed or evicted using a clock algorithm in order to
+ * bound the memory of a table. Both free entries and thus must not run
+ * while other threads access the table.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "hash.h"
+#include "cmap.h"
+#include "config.h"
+
+/*
+ * Atomic primitives. Publishing an entry uses release semantics, so that a
+ * reader which sees the entry through an acquire load also sees its key
+ * and data.
+ */
+#define LOAD_PTR(p)       __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define CAS_PTR(p, o, n)  __atomic_compare_exchange_n(&(p), &(o), (n), 0, \
+                             __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)
+#define ATOMIC_INC(i)     __atomic_add_fetch(&(i), 1, __ATOMIC_RELAXED)
+#define ATOMIC_ADD(i, n)  __atomic_add_fetch(&(i), (n), __ATOMIC_RELAXED)
+#define ATOMIC_OR(i, n)   __atomic_fetch_or(&(i), (n), __ATOMIC_RELAXED)
+
+#define ENTRY_KEY(e)      ((e)->p_mem)
+#define ENTRY_DATA(e)     ((e)->p_mem + (e)->i_key_size)
+#define ENTRY_SIZE(k, d)  (offsetof(cmap_entry_t, p_mem) + (k) + (d))
+
+#define FLAG_REF          1	/* Entry has been accessed recently */
+#define FLAG_CLEAN        2	/* Entry has a copy in a backing store */
+#define FLAG_PIN          4	/* Entry could not be evicted */
+
+/**
+ * Compute the hash value of a key. The one-at-a-time hash of the generic
+ * hash table is used.
+ * @param i_key_size size of key
+ * @param p_key key
+ * @return hash value
+ */
+static unsigned int cmap_hash(unsigned int i_key_size, void *p_key)
+{
+   hash_key_t key;
+
+   key.i_size = i_key_size;
+   key.p_key = p_key;
+
+   return hash_one_at_a_time_hash(&key);
+}
+
+/**
+ * Search a key within a part of a bucket list. The list is searched from
+ * the given entry up to (excluding) the stop entry.
+ * @param p_entry first entry to check
+ * @param p_stop entry to stop at or NULL
+ * @param i_hash hash value of key
+ * @param i_key_size size of key
+ * @param p_key key
+ * @return matching entry or NULL
+ */
+static cmap_entry_t *cmap_search(cmap_entry_t * p_entry,
+				 cmap_entry_t * p_stop, unsigned int i_hash,
+				 unsigned int i_key_size, void *p_key)
+{
+   for (; p_entry != p_stop; p_entry = LOAD_PTR(p_entry->p_next)) {
+      if (p_entry->i_hash == i_hash &&
+	  p_entry->i_key_size == i_key_size &&
+	  !memcmp(ENTRY_KEY(p_entry), p_key, i_key_size))
+	 return p_entry;
+   }
+
+   return NULL;
+}
+
+/**
+ * Create a new concurrent mapping table. The number of buckets is rounded
+ * to the next higher power of two and is never changed afterwards.
+ * @param i_size number of buckets
+ * @return table or NULL on failure
+ */
+cmap_t *cmap_create(unsigned int i_size)
+{
+   cmap_t *p_map;
+
+   if (!(p_map = malloc(sizeof(cmap_t))))
+      return NULL;
+
+   p_map->i_size = 1;
+   while (p_map->i_size < i_size)
+      p_map->i_size <<= 1;
+
+   p_map->i_size_mask = p_map->i_size - 1;
+   p_map->i_items = 0;
+   p_map->i_bytes = 0;
+   p_map->i_hand = 0;
+
+   p_map->pp_buckets = calloc(p_map->i_size, sizeof(cmap_entry_t *));
+   if (!p_map->pp_buckets) {
+      free(p_map);
+      return NULL;
+   }
+
+   return p_map;
+}
+
+/**
+ * Lookup the data associated with a key. This function never blocks and
+ * may be called concurrently with cmap_insert().
+ * @param p_map table
+ * @param i_key_size size of key
+ * @param p_key key
+ * @return pointer to data or NULL if the key is not present
+ */
+void *cmap_get(cmap_t * p_map, unsigned int i_key_size, void *p_key)
+{
+   cmap_entry_t *p_entry;
+   unsigned int i_hash;
+
+   i_hash = cmap_hash(i_key_size, p_key);
+   p_entry = LOAD_PTR(p_map->pp_buckets[i_hash & p_map->i_size_mask]);
+   p_entry = cmap_search(p_entry, NULL, i_hash, i_key_size, p_key);
+   if (!p_entry)
+      return NULL;
+
+   /*
+    * Avoid dirtying the cache line if the reference flag is already set.
+    * Concurrent readers set the flag atomically.
+    */
+   if (!(__atomic_load_n(&p_entry->i_flags, __ATOMIC_RELAXED) & FLAG_REF))
+      ATOMIC_OR(p_entry->i_flags, FLAG_REF);
+
+   return ENTRY_DATA(p_entry);
+}
+
+/**
+ * Insert data for a key unless the key is already present. The key and
+ * the data are copied into the table. If the key is present, either
+ * because it has been inserted before or because another thread won the
+ * race for it, the present data is returned and the given data is
+ * discarded. Thus all callers end up with the same data for a key.
+ * @param p_map table
+ * @param i_key_size size of key
+ * @param p_key key
+ * @param i_data_size size of data
+ * @param p_data data
+ * @return pointer to the data associated with the key or NULL on failure
+ */
+void *cmap_insert(cmap_t * p_map, unsigned int i_key_size, void *p_key,
+		  unsigned int i_data_size, void *p_data)
+{
+   cmap_entry_t *p_entry, *p_head, *p_stop, *p_new = NULL;
+   unsigned int i_hash, l_bucket;
+
+   i_hash = cmap_hash(i_key_size, p_key);
+   l_bucket = i_hash & p_map->i_size_mask;
+
+   p_head = LOAD_PTR(p_map->pp_buckets[l_bucket]);
+   p_stop = NULL;
+
+   for (;;) {
+      /*
+       * Only entries published since the last scan need to be checked.
+       */
+      p_entry = cmap_search(p_head, p_stop, i_hash, i_key_size, p_key);
+      if (p_entry) {
+	 free(p_new);
+	 return ENTRY_DATA(p_entry);
+      }
+
+      if (!p_new) {
+	 p_new = malloc(ENTRY_SIZE(i_key_size, i_data_size));
+	 if (!p_new)
+	    return NULL;
+
+	 p_new->i_hash = i_hash;
+	 p_new->i_key_size = i_key_size;
+	 p_new->i_data_size = i_data_size;
+	 p_new->i_flags = FLAG_REF;
+	 memcpy(ENTRY_KEY(p_new), p_key, i_key_size);
+	 memcpy(ENTRY_DATA(p_new), p_data, i_data_size);
+      }
+
+      p_new->p_next = p_head;
+      p_stop = p_head;
+
+      /*
+       * On failure p_head is updated to the current head of the bucket.
+       */
+      if (CAS_PTR(p_map->pp_buckets[l_bucket], p_head, p_new)) {
+	 ATOMIC_INC(p_map->i_items);
+	 ATOMIC_ADD(p_map->i_bytes, ENTRY_SIZE(i_key_size, i_data_size));
+	 return ENTRY_DATA(p_new);
+      }
+   }
+}
+
+/**
+ * Remove a key and its data from the table. The table must not be
+ * accessed by other threads during this call.
+ * @param p_map table
+ * @param i_key_size size of key
+ * @param p_key key
+ * @return 1 if the key has been removed or 0 if it is not present
+ */
+int cmap_remove(cmap_t * p_map, unsigned int i_key_size, void *p_key)
+{
+   cmap_entry_t *p_entry, **pp_prev;
+   unsigned int i_hash;
+
+   i_hash = cmap_hash(i_key_size, p_key);
+   pp_prev = &p_map->pp_buckets[i_hash & p_map->i_size_mask];
+
+   for (; (p_entry = *pp_prev); pp_prev = &p_entry->p_next) {
+      if (p_entry->i_hash == i_hash &&
+	  p_entry->i_key_size == i_key_size &&
+	  !memcmp(ENTRY_KEY(p_entry), p_key, i_key_size)) {
+	 *pp_prev = p_entry->p_next;
+	 p_map->i_items--;
+	 p_map->i_bytes -= ENTRY_SIZE(p_entry->i_key_size,
+				      p_entry->i_data_size);
+	 free(p_entry);
+	 return 1;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Mark an entry as clean. A clean entry has an identical copy in a
+ * backing store and is not passed to the eviction callback.
+ * @param p_data data of entry as returned by cmap_get() or cmap_insert()
+ * @param i_key_size size of the key of the entry
+ */
+void cmap_set_clean(void *p_data, unsigned int i_key_size)
+{
+   cmap_entry_t *p_entry;
+
+   p_entry = (cmap_entry_t *) ((unsigned char *) p_data - i_key_size -
+			       offsetof(cmap_entry_t, p_mem));
+   p_entry->i_flags |= FLAG_CLEAN;
+}
+
+/**
+ * Evict entries until the memory used by the table drops below the given
+ * number of bytes. The clock algorithm sweeps over the buckets: recently
+ * accessed entries get their reference flag cleared and a second chance,
+ * all other entries are passed to the callback and removed. Entries the
+ * callback fails on are pinned in memory and skipped by later sweeps. The
+ * table must not be accessed by other threads during this call.
+ * @param p_map table
+ * @param i_bytes target memory of entries
+ * @param fn_evict callback for dirty entries or NULL
+ * @return number of evicted entries
+ */
+unsigned int cmap_evict(cmap_t * p_map, unsigned long i_bytes,
+			cmap_fn_evict_t fn_evict)
+{
+   cmap_entry_t *p_entry, **pp_prev;
+   unsigned int i_count = 0, i_sweep = 0;
+
+   /*
+    * All reference flags are cleared after one full sweep, so two sweeps
+    * are enough to evict every entry.
+    */
+   while (p_map->i_bytes > i_bytes && i_sweep < 2 * p_map->i_size) {
+      pp_prev = &p_map->pp_buckets[p_map->i_hand];
+
+      while ((p_entry = *pp_prev) && p_map->i_bytes > i_bytes) {
+	 if (p_entry->i_flags & (FLAG_REF | FLAG_PIN)) {
+	    p_entry->i_flags &= ~FLAG_REF;
+	    pp_prev = &p_entry->p_next;
+	    continue;
+	 }
+
+	 if (fn_evict && !(p_entry->i_flags & FLAG_CLEAN) &&
+	     !fn_evict(p_entry->i_key_size, ENTRY_KEY(p_entry),
+		       p_entry->i_data_size, ENTRY_DATA(p_entry))) {
+	    p_entry->i_flags |= FLAG_PIN;
+	    pp_prev = &p_entry->p_next;
+	    continue;
+	 }
+
+	 *pp_prev = p_entry->p_next;
+	 p_map->i_items--;
+	 p_map->i_bytes -= ENTRY_SIZE(p_entry->i_key_size,
+				      p_entry->i_data_size);
+	 free(p_entry);
+	 i_count++;
+      }
+
+      p_map->i_hand = (p_map->i_hand + 1) & p_map->i_size_mask;
+      i_sweep++;
+   }
+
+   return i_count;
+}
+
+/**
+ * Free the table and all of its entries. The table must not be accessed
+ * by other threads during this call.
+ * @param p_map table
+ */
+void cmap_finalize(cmap_t * p_map)
+{
+   cmap_entry_t *p_entry, *p_next;
+   unsigned int i;
+
+   if (!p_map)
+      return;
+
+   for (i = 0; i < p_map->i_size; i++) {
+      for (p_entry = p_map->pp_buckets[i]; p_entry; p_entry = p_next) {
+	 p_next = p_entry->p_next;
+	 free(p_entry);
+      }
+   }
+
+   free(p_map->pp_buckets);
+   free(p_map);
+}
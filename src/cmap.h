@@ -0,0 +1,78 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file cmap.h Concurrent mapping table header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _CMAP_H
+#define _CMAP_H
+
+/**
+ * Entry of a concurrent mapping table. The key and the data are stored
+ * inline after the entry, so that an entry is allocated with a single
+ * call to malloc(). Apart from their flags, entries are immutable once
+ * they have been published.
+ */
+typedef struct s_cmap_entry {
+   struct s_cmap_entry *p_next;	     /**< Next entry in the bucket */
+   unsigned int i_hash;		     /**< Hash value of the key */
+   unsigned short i_key_size;	     /**< Size of the key in bytes */
+   unsigned short i_data_size;	     /**< Size of the data in bytes */
+   unsigned char i_flags;	     /**< Reference and clean flags */
+   unsigned char p_mem[1];	     /**< Key followed by data */
+} cmap_entry_t;
+
+/**
+ * Concurrent insert-only mapping table. The table has a fixed number of
+ * buckets, each bucket holding a singly linked list of entries.
+ */
+typedef struct {
+   unsigned int i_items;	     /**< The current number of items */
+   unsigned int i_size;		     /**< The number of buckets */
+   unsigned int i_size_mask;	     /**< Mask to & hash values with */
+   unsigned long i_bytes;	     /**< Memory used by the entries */
+   unsigned int i_hand;		     /**< Clock hand for eviction */
+   cmap_entry_t **pp_buckets;	     /**< The bucket lists */
+} cmap_t;
+
+/**
+ * Callback for evicted entries. The callback receives the key and the
+ * data of each entry that is removed from the table and has not been
+ * marked clean. It returns 1 on success and 0 on failure.
+ */
+typedef int (*cmap_fn_evict_t) (unsigned int i_key_size, void *p_key,
+				unsigned int i_data_size, void *p_data);
+
+cmap_t *cmap_create(unsigned int i_size);
+void *cmap_get(cmap_t * p_map, unsigned int i_key_size, void *p_key);
+void *cmap_insert(cmap_t * p_map, unsigned int i_key_size, void *p_key,
+		  unsigned int i_data_size, void *p_data);
+int cmap_remove(cmap_t * p_map, unsigned int i_key_size, void *p_key);
+void cmap_set_clean(void *p_data, unsigned int i_key_size);
+unsigned int cmap_evict(cmap_t * p_map, unsigned long i_bytes,
+			cmap_fn_evict_t fn_evict);
+void cmap_finalize(cmap_t * p_map);
+
+#endif				/* _CMAP_H */
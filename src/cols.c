@@ -0,0 +1,398 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file cols.c Columnar output.
+ * Records can be written as rows of a set of typed columns instead of a
+ * trail. Each column is stored in a file of its own, so that a query only
+ * has to read the columns it needs. Rows are collected while the tokens
+ * of a record pass by and are written in row groups of COLS_GROUP rows.
+ * Paths and event IDs are dictionary encoded: their columns hold IDs that
+ * index the strings of path.dict and the event IDs of event.dict. Missing
+ * values are stored as COLS_NULL.
+ *
+ * The directory additionally holds a file meta, describing the number of
+ * rows, the size of row groups and the type of each column.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "cmap.h"
+#include "field.h"
+#include "bsm.h"
+#include "cols.h"
+#include "config.h"
+
+#define SEEN_SUBJECT      1		/**< Subject of record has been seen */
+#define SEEN_PATH         2		/**< Path of record has been seen */
+#define SEEN_RETURN       4		/**< Return of record has been seen */
+
+/**
+ * Names, widths and types of the columns.
+ */
+static struct {
+   char *name;
+   int width;
+   char *type;
+} columns[COLS] = {
+   {"time", 8, "uint64"},
+   {"event", 4, "dict:event.dict:uint16"},
+   {"auid", 4, "uint32"},
+   {"euid", 4, "uint32"},
+   {"pid", 4, "uint32"},
+   {"ret", 4, "int32"},
+   {"path", 4, "dict:path.dict:string"},
+   {"addr", 16, "inet6"}
+};
+
+/**
+ * Open a file within the output directory.
+ * @param c writer
+ * @param name name of file
+ * @return file or NULL on failure
+ */
+static FILE *cols_file(cols_t * c, char *name)
+{
+   char path[1024];
+   FILE *fp;
+
+   snprintf(path, sizeof(path), "%s/%s", c->dir, name);
+   if (!(fp = fopen(path, "wb")))
+      err_msg("Could not open %s", path);
+
+   return fp;
+}
+
+/**
+ * Create a columnar writer. The directory is created if it doesn't exist
+ * and existing column files are overwritten.
+ * @param dir output directory
+ * @return writer or NULL on failure
+ */
+cols_t *cols_open(char *dir)
+{
+   char name[64];
+   cols_t *c;
+   int i;
+
+   if (mkdir(dir, 0755) && errno != EEXIST) {
+      err_msg("Could not create %s", dir);
+      return NULL;
+   }
+
+   if (!(c = calloc(1, sizeof(cols_t)))) {
+      err_msg("Failed to allocate memory");
+      return NULL;
+   }
+
+   c->dir = dir;
+   c->paths = cmap_create(COLS_DICT_SIZE);
+   c->events = malloc(65536 * sizeof(uint32_t));
+   if (!c->paths || !c->events) {
+      err_msg("Failed to allocate memory");
+      goto err;
+   }
+   memset(c->events, 0xff, 65536 * sizeof(uint32_t));
+
+   for (i = 0; i < COLS; i++) {
+      snprintf(name, sizeof(name), "%s.col", columns[i].name);
+      if (!(c->fp[i] = cols_file(c, name)))
+	 goto err;
+
+      if (!(c->col[i] = malloc(COLS_GROUP * columns[i].width))) {
+	 err_msg("Failed to allocate memory");
+	 goto err;
+      }
+   }
+
+   c->path_dict = cols_file(c, "path.dict");
+   c->event_dict = cols_file(c, "event.dict");
+   if (!c->path_dict || !c->event_dict)
+      goto err;
+
+   return c;
+
+ err:
+   cols_close(c);
+   return NULL;
+}
+
+/**
+ * Write the buffered row group to the column files.
+ * @param c writer
+ * @return 1 on success or 0 on failure
+ */
+static int cols_flush(cols_t * c)
+{
+   int i;
+
+   for (i = 0; i < COLS && c->rows; i++) {
+      if (fwrite(c->col[i], columns[i].width, c->rows, c->fp[i]) !=
+	  c->rows) {
+	 err_msg("Could not write %s column", columns[i].name);
+	 return 0;
+      }
+   }
+
+   c->total += c->rows;
+   c->rows = 0;
+   return 1;
+}
+
+/**
+ * Append the row being built to the buffered row group.
+ * @param c writer
+ * @return 1 on success or 0 on failure
+ */
+static int cols_commit(cols_t * c)
+{
+   int i;
+
+   for (i = 0; i < COLS; i++)
+      memcpy(c->col[i] + c->rows * columns[i].width, c->row[i],
+	     columns[i].width);
+
+   c->open = 0;
+   if (++c->rows == COLS_GROUP)
+      return cols_flush(c);
+
+   return 1;
+}
+
+/**
+ * Look up the dictionary ID of a path. New paths are appended to the
+ * dictionary.
+ * @param c writer
+ * @param path path
+ * @param len maximum length of path
+ * @return dictionary ID or COLS_NULL on failure
+ */
+static uint32_t cols_path(cols_t * c, uchar_t * path, int len)
+{
+   uint32_t *id;
+   uchar_t *end;
+
+   if ((end = memchr(path, 0, len)))
+      len = end - path;
+
+   if ((id = cmap_get(c->paths, len, path)))
+      return *id;
+
+   if (!(id = cmap_insert(c->paths, len, path, sizeof(uint32_t),
+			  &c->npaths)))
+      return COLS_NULL;
+
+   fwrite(path, 1, len, c->path_dict);
+   fputc(0, c->path_dict);
+   return c->npaths++;
+}
+
+/**
+ * Look up the dictionary ID of an event. New events are appended to the
+ * dictionary.
+ * @param c writer
+ * @param event event ID
+ * @return dictionary ID
+ */
+static uint32_t cols_event(cols_t * c, ushort_t event)
+{
+   uchar_t tmp[2];
+
+   if (c->events[event] == COLS_NULL) {
+      field_put16(tmp, event);
+      fwrite(tmp, 1, 2, c->event_dict);
+      c->events[event] = c->nevents++;
+   }
+
+   return c->events[event];
+}
+
+/**
+ * Start a new row for a record.
+ * @param c writer
+ * @param buf header token
+ */
+static void cols_header(cols_t * c, uchar_t * buf)
+{
+   memset(c->row, 0xff, sizeof(c->row));
+   memset(c->row[COL_ADDR], 0, 16);
+   c->open = 1;
+   c->seen = 0;
+
+   field_put64(c->row[COL_TIME], bsm_time(buf));
+
+   field_put32(c->row[COL_EVENT], cols_event(c, field_get16(buf + 6)));
+}
+
+/**
+ * Fill the subject columns of the row. IPv4 addresses are stored as
+ * IPv4-mapped IPv6 addresses.
+ * @param c writer
+ * @param buf subject token
+ */
+static void cols_subject(cols_t * c, uchar_t * buf)
+{
+   int pos, alen = 4;
+
+   memcpy(c->row[COL_AUID], buf + 1, 4);
+   memcpy(c->row[COL_EUID], buf + 5, 4);
+   memcpy(c->row[COL_PID], buf + 21, 4);
+
+   switch (buf[0]) {
+   case AUT_SUBJECT32:
+      pos = 33;
+      break;
+   case AUT_SUBJECT64:
+      pos = 37;
+      break;
+   case AUT_SUBJECT32_EX:
+      alen = field_get32(buf + 33) == AU_IPv6 ? 16 : 4;
+      pos = 37;
+      break;
+   default:
+      alen = field_get32(buf + 37) == AU_IPv6 ? 16 : 4;
+      pos = 41;
+      break;
+   }
+
+   if (alen == 16) {
+      memcpy(c->row[COL_ADDR], buf + pos, 16);
+   } else {
+      c->row[COL_ADDR][10] = c->row[COL_ADDR][11] = 0xff;
+      memcpy(c->row[COL_ADDR] + 12, buf + pos, 4);
+   }
+
+   c->seen |= SEEN_SUBJECT;
+}
+
+/**
+ * Pass a pseudonymized token to the writer. The columns are filled from
+ * the header, the first subject, the first path and the return token of a
+ * record, and the row is added when the trailer is reached. A record
+ * without trailer is added when the next header is reached.
+ * @param c writer
+ * @param buf buffer containing the token
+ * @param len length of token
+ * @return 1 on success or 0 on failure
+ */
+int cols_token(cols_t * c, uchar_t * buf, int len)
+{
+   uint32_t id;
+
+   switch (buf[0]) {
+   case AUT_HEADER32:
+   case AUT_HEADER32_EX:
+   case AUT_HEADER64:
+   case AUT_HEADER64_EX:
+      if (c->open && !cols_commit(c))
+	 return 0;
+      cols_header(c, buf);
+      break;
+   case AUT_SUBJECT32:
+   case AUT_SUBJECT64:
+   case AUT_SUBJECT32_EX:
+   case AUT_SUBJECT64_EX:
+      if (c->open && !(c->seen & SEEN_SUBJECT))
+	 cols_subject(c, buf);
+      break;
+   case AUT_PATH:
+      if (!c->open || (c->seen & SEEN_PATH))
+	 break;
+      id = cols_path(c, buf + 3, len - 3);
+      field_put32(c->row[COL_PATH], id);
+      c->seen |= SEEN_PATH;
+      break;
+   case AUT_RETURN32:
+      if (c->open && !(c->seen & SEEN_RETURN)) {
+	 memcpy(c->row[COL_RET], buf + 2, 4);
+	 c->seen |= SEEN_RETURN;
+      }
+      break;
+   case AUT_RETURN64:
+      if (c->open && !(c->seen & SEEN_RETURN)) {
+	 field_put32(c->row[COL_RET], field_get64(buf + 2));
+	 c->seen |= SEEN_RETURN;
+      }
+      break;
+   case AUT_TRAILER:
+      if (c->open)
+	 return cols_commit(c);
+      break;
+   }
+
+   return 1;
+}
+
+/**
+ * Write the remaining rows and the description of the columns, close all
+ * files and free the writer.
+ * @param c writer
+ * @return 1 on success or 0 on failure
+ */
+int cols_close(cols_t * c)
+{
+   FILE *meta;
+   int i, ret = 1;
+
+   if (c->fp[COLS - 1] && c->event_dict) {
+      if ((c->open && !cols_commit(c)) || !cols_flush(c))
+	 ret = 0;
+
+      if ((meta = cols_file(c, "meta"))) {
+	 fprintf(meta, "rows %ld\ngroup %d\nbyteorder big\n", c->total,
+		 COLS_GROUP);
+	 for (i = 0; i < COLS; i++)
+	    fprintf(meta, "column %s.col %d %s\n", columns[i].name,
+		    columns[i].width, columns[i].type);
+	 fclose(meta);
+      } else
+	 ret = 0;
+   }
+
+   for (i = 0; i < COLS; i++) {
+      if (c->fp[i] && fclose(c->fp[i]))
+	 ret = 0;
+      free(c->col[i]);
+   }
+
+   if (c->path_dict && fclose(c->path_dict))
+      ret = 0;
+   if (c->event_dict && fclose(c->event_dict))
+      ret = 0;
+
+   cmap_finalize(c->paths);
+   free(c->events);
+   free(c);
+   return ret;
+}
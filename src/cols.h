@@ -0,0 +1,72 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file cols.h Columnar output header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _COLS_H
+#define _COLS_H
+
+#define COLS_GROUP        65536		/**< Rows per row group */
+#define COLS_DICT_SIZE    65536		/**< Initial size of path dictionary */
+#define COLS_NULL         0xffffffff	/**< Missing value of a column */
+
+#define COL_TIME          0		/**< Time of record (8 bytes) */
+#define COL_EVENT         1		/**< Event ID (4 byte dictionary ID) */
+#define COL_AUID          2		/**< Audit user ID of subject */
+#define COL_EUID          3		/**< Effective user ID of subject */
+#define COL_PID           4		/**< Process ID of subject */
+#define COL_RET           5		/**< Return value (signed) */
+#define COL_PATH          6		/**< First path (4 byte dictionary ID) */
+#define COL_ADDR          7		/**< Address of subject (16 bytes) */
+#define COLS              8		/**< Number of columns */
+
+/**
+ * State of the columnar writer. Each column is buffered for one row group
+ * in its encoded form and written to its own file when the group is full.
+ * All values are stored in network byte order.
+ */
+typedef struct s_cols {
+   char *dir;			     /**< Output directory */
+   FILE *fp[COLS];		     /**< Column files */
+   uchar_t *col[COLS];		     /**< Buffered row group of columns */
+   uchar_t row[COLS][16];	     /**< Row being built */
+   int open;			     /**< A record is being walked */
+   int seen;			     /**< Flags of tokens seen in record */
+   int rows;			     /**< Rows in buffered row group */
+   long total;			     /**< Rows written in total */
+   cmap_t *paths;		     /**< Dictionary of paths */
+   uint32_t npaths;		     /**< Number of paths in dictionary */
+   FILE *path_dict;		     /**< Strings of path dictionary */
+   uint32_t *events;		     /**< Dictionary IDs of events */
+   uint32_t nevents;		     /**< Number of events in dictionary */
+   FILE *event_dict;		     /**< Event IDs of event dictionary */
+} cols_t;
+
+cols_t *cols_open(char *dir);
+int cols_token(cols_t * c, uchar_t * buf, int len);
+int cols_close(cols_t * c);
+
+#endif				/* _COLS_H */
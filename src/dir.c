@@ -0,0 +1,328 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file dir.c Audit directories.
+ * Instead of single files, a directory of audit trails can be given as
+ * input, e.g. /var/audit. auditd(1M) names its trail files start.end.host,
+ * where start and end are times of the form YYYYMMDDhhmmss and end is
+ * not_terminated for the current file. The trail files of a directory are
+ * processed in the order of their names and thus of their start times.
+ * Other files, e.g. cached indices of compressed trails, are skipped.
+ *
+ * A directory often holds thousands of small trails, each of which would
+ * be read from a cold page cache. Therefore, while one file is processed,
+ * a thread advises the kernel to read the next DIR_PREFETCH files.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "misc.h"
+#include "dir.h"
+#include "config.h"
+
+/**
+ * Check whether a string starts with a time of the form YYYYMMDDhhmmss
+ * followed by a dot.
+ * @param str string
+ * @return 1 if it does or 0 otherwise
+ */
+static int dir_time(char *str)
+{
+   int i;
+
+   for (i = 0; i < 14; i++)
+      if (!isdigit((unsigned char) str[i]))
+	 return 0;
+
+   return str[14] == '.';
+}
+
+/**
+ * Check whether a file name is the name of a trail file written by
+ * auditd(1M).
+ * @param name file name
+ * @return 1 if it is or 0 otherwise
+ */
+static int dir_trail(char *name)
+{
+   int len = strlen(name);
+
+   if (!dir_time(name) || (!dir_time(name + 15) &&
+			   strncmp(name + 15, "not_terminated.", 15)))
+      return 0;
+
+   /*
+    * Cached indices of compressed trails share the name of their trail.
+    */
+   return len > 30 && strcmp(name + len - 5, ".zidx");
+}
+
+/**
+ * Compare two names for qsort().
+ * @param a first name
+ * @param b second name
+ * @return result of strcmp()
+ */
+static int dir_compare(const void *a, const void *b)
+{
+   return strcmp(*(char **) a, *(char **) b);
+}
+
+/**
+ * Append the trail files of a directory to a list of names, ordered by
+ * their start times.
+ * @param dir name of directory
+ * @param names list of names
+ * @param num number of names
+ * @param size size of list
+ * @return 1 on success or 0 on failure
+ */
+static int dir_scan(char *dir, char ***names, int *num, int *size)
+{
+   struct dirent *e;
+   char **tmp, *name;
+   int first = *num;
+   DIR *d;
+
+   if (!(d = opendir(dir))) {
+      err_msg("Could not open %s", dir);
+      return 0;
+   }
+
+   while ((e = readdir(d))) {
+      if (!dir_trail(e->d_name))
+	 continue;
+
+      if (*num == *size) {
+	 *size *= 2;
+	 if (!(tmp = realloc(*names, *size * sizeof(char *))))
+	    goto err;
+	 *names = tmp;
+      }
+
+      if (!(name = malloc(strlen(dir) + strlen(e->d_name) + 2)))
+	 goto err;
+      sprintf(name, "%s/%s", dir, e->d_name);
+      (*names)[(*num)++] = name;
+   }
+   closedir(d);
+
+   if (*num == first)
+      err_msg("No audit trail files in %s", dir);
+
+   qsort(*names + first, *num - first, sizeof(char *), dir_compare);
+   return 1;
+
+ err:
+   err_msg("Failed to allocate memory");
+   closedir(d);
+   return 0;
+}
+
+/**
+ * Replace the directories among the input files by their trail files.
+ * The arguments before the input files are kept.
+ * @param argc number of arguments
+ * @param argv array of arguments
+ * @param first index of first input file
+ * @return 1 on success or 0 on failure
+ */
+int dir_expand(int *argc, char ***argv, int first)
+{
+   char **names;
+   struct stat st;
+   int i, num, size;
+
+   for (i = first; i < *argc; i++)
+      if (!stat((*argv)[i], &st) && S_ISDIR(st.st_mode))
+	 break;
+
+   if (i == *argc)
+      return 1;
+
+   size = *argc + 16;
+   if (!(names = malloc(size * sizeof(char *)))) {
+      err_msg("Failed to allocate memory");
+      return 0;
+   }
+
+   for (num = 0; num < i; num++)
+      names[num] = (*argv)[num];
+
+   for (; i < *argc; i++) {
+      if (!stat((*argv)[i], &st) && S_ISDIR(st.st_mode)) {
+	 if (!dir_scan((*argv)[i], &names, &num, &size))
+	    return 0;
+	 continue;
+      }
+
+      if (num == size) {
+	 size *= 2;
+	 if (!(names = realloc(names, size * sizeof(char *)))) {
+	    err_msg("Failed to allocate memory");
+	    return 0;
+	 }
+      }
+      names[num++] = (*argv)[i];
+   }
+
+   *argc = num;
+   *argv = names;
+   return 1;
+}
+
+/**
+ * Advise the kernel to read a file into the page cache.
+ * @param name name of file
+ */
+static void dir_advise(char *name)
+{
+#ifdef HAVE_POSIX_FADVISE
+   int fd;
+
+   if ((fd = open(name, O_RDONLY)) < 0)
+      return;
+
+   posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+   close(fd);
+#endif
+}
+
+/**
+ * Thread advising the kernel to read files ahead. The files up to
+ * DIR_PREFETCH after the current one are advised once.
+ * @param arg prefetch
+ * @return NULL
+ */
+static void *dir_prefetch_thread(void *arg)
+{
+   dir_prefetch_t *p = arg;
+   char *name;
+
+   pthread_mutex_lock(&p->lock);
+   for (;;) {
+      while (!p->stop && (p->next >= p->num ||
+			  p->next > p->current + DIR_PREFETCH))
+	 pthread_cond_wait(&p->cond, &p->lock);
+      if (p->stop)
+	 break;
+
+      name = p->names[p->next++];
+      pthread_mutex_unlock(&p->lock);
+
+      dir_advise(name);
+
+      pthread_mutex_lock(&p->lock);
+   }
+   pthread_mutex_unlock(&p->lock);
+
+   return NULL;
+}
+
+/**
+ * Start prefetching a list of input files. Without posix_fadvise(3C)
+ * nothing is prefetched.
+ * @param names names of files
+ * @param num number of files
+ * @return prefetch or NULL if files can't be prefetched
+ */
+dir_prefetch_t *dir_prefetch_start(char **names, int num)
+{
+   dir_prefetch_t *p;
+
+#ifndef HAVE_POSIX_FADVISE
+   num = 0;
+#endif
+
+   if (num < 2 || !(p = calloc(1, sizeof(dir_prefetch_t))))
+      return NULL;
+
+   p->names = names;
+   p->num = num;
+
+   /*
+    * The first file is opened right away, prefetching starts with the
+    * second one.
+    */
+   p->next = 1;
+
+   pthread_mutex_init(&p->lock, NULL);
+   pthread_cond_init(&p->cond, NULL);
+   if (pthread_create(&p->thread, NULL, dir_prefetch_thread, p)) {
+      pthread_mutex_destroy(&p->lock);
+      pthread_cond_destroy(&p->cond);
+      free(p);
+      return NULL;
+   }
+
+   return p;
+}
+
+/**
+ * Note the file being processed, so that the following files are
+ * prefetched.
+ * @param p prefetch or NULL
+ * @param current index of file
+ */
+void dir_prefetch(dir_prefetch_t * p, int current)
+{
+   if (!p)
+      return;
+
+   pthread_mutex_lock(&p->lock);
+   p->current = current;
+   pthread_cond_broadcast(&p->cond);
+   pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * Stop prefetching.
+ * @param p prefetch or NULL
+ */
+void dir_prefetch_stop(dir_prefetch_t * p)
+{
+   if (!p)
+      return;
+
+   pthread_mutex_lock(&p->lock);
+   p->stop = 1;
+   pthread_cond_broadcast(&p->cond);
+   pthread_mutex_unlock(&p->lock);
+   pthread_join(p->thread, NULL);
+
+   pthread_mutex_destroy(&p->lock);
+   pthread_cond_destroy(&p->cond);
+   free(p);
+}
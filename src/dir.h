@@ -0,0 +1,54 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file dir.h Audit directory header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _DIR_H
+#define _DIR_H
+
+#define DIR_PREFETCH      8		/**< Number of files read ahead */
+
+/**
+ * Prefetch of input files. A thread advises the kernel to read the files
+ * following the current one into the page cache.
+ */
+typedef struct s_dir_prefetch {
+   pthread_t thread;		     /**< Prefetching thread */
+   pthread_mutex_t lock;	     /**< Lock of positions */
+   pthread_cond_t cond;		     /**< Change of positions */
+   char **names;		     /**< Names of files */
+   int num;			     /**< Number of files */
+   int current;			     /**< File being processed */
+   int next;			     /**< Next file to prefetch */
+   int stop;			     /**< Thread has to stop */
+} dir_prefetch_t;
+
+int dir_expand(int *argc, char ***argv, int first);
+dir_prefetch_t *dir_prefetch_start(char **names, int num);
+void dir_prefetch(dir_prefetch_t * p, int current);
+void dir_prefetch_stop(dir_prefetch_t * p);
+
+#endif				/* _DIR_H */
@@ -0,0 +1,756 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file emit.c Text and JSON emitter.
+ * Pseudonymized tokens can be formatted directly instead of being written
+ * in binary form, which saves a separate run of praudit(1M). The text
+ * format follows the raw format of praudit: one line per token, holding
+ * the name of the token and its fields separated by commas. The JSON
+ * format writes one object per record holding the array of its tokens.
+ *
+ * All numbers, addresses and strings are formatted by hand into a large
+ * buffer, so that no memory is allocated and no stdio is involved per
+ * token.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "field.h"
+#include "bsm.h"
+#include "emit.h"
+#include "config.h"
+
+/**
+ * Write the buffer of an emitter to the output stream.
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+static int emit_flush(bsm_out_t * o)
+{
+   emit_t *e = o->emit;
+   int ret;
+
+   ret = bsm_write(o, e->buf, e->len);
+   e->len = 0;
+   return ret;
+}
+
+/**
+ * Make room for a number of bytes in the buffer.
+ * @param o output stream
+ * @param n number of bytes
+ * @return 1 on success or 0 on failure
+ */
+static int emit_room(bsm_out_t * o, int n)
+{
+   if (o->emit->len + n <= EMIT_BUFFER_SIZE)
+      return 1;
+
+   return emit_flush(o);
+}
+
+/**
+ * Append raw bytes to the buffer. The caller has made room.
+ * @param e emitter
+ * @param s bytes
+ * @param n number of bytes
+ */
+static void emit_raw(emit_t * e, const char *s, int n)
+{
+   memcpy(e->buf + e->len, s, n);
+   e->len += n;
+}
+
+/**
+ * Append an unsigned decimal number to the buffer.
+ * @param e emitter
+ * @param v number
+ */
+static void emit_dec(emit_t * e, uint64_t v)
+{
+   char tmp[20];
+   int i = sizeof(tmp);
+
+   do {
+      tmp[--i] = '0' + v % 10;
+      v /= 10;
+   } while (v);
+
+   emit_raw(e, tmp + i, sizeof(tmp) - i);
+}
+
+/**
+ * Start a field. In text format fields are separated by commas, in JSON
+ * format the key of the field is written.
+ * @param e emitter
+ * @param key name of field
+ */
+static void emit_key(emit_t * e, const char *key)
+{
+   if (e->format == EMIT_TEXT) {
+      e->buf[e->len++] = ',';
+      return;
+   }
+
+   emit_raw(e, ",\"", 2);
+   emit_raw(e, key, strlen(key));
+   emit_raw(e, "\":", 2);
+}
+
+/**
+ * Emit an unsigned number field.
+ * @param o output stream
+ * @param key name of field
+ * @param v value
+ * @return 1 on success or 0 on failure
+ */
+static int emit_uint(bsm_out_t * o, const char *key, uint64_t v)
+{
+   if (!emit_room(o, EMIT_RESERVE))
+      return 0;
+
+   emit_key(o->emit, key);
+   emit_dec(o->emit, v);
+   return 1;
+}
+
+/**
+ * Emit a signed number field.
+ * @param o output stream
+ * @param key name of field
+ * @param v value
+ * @return 1 on success or 0 on failure
+ */
+static int emit_int(bsm_out_t * o, const char *key, int64_t v)
+{
+   if (!emit_room(o, EMIT_RESERVE))
+      return 0;
+
+   emit_key(o->emit, key);
+   if (v < 0) {
+      o->emit->buf[o->emit->len++] = '-';
+      emit_dec(o->emit, -(uint64_t) v);
+   } else
+      emit_dec(o->emit, v);
+   return 1;
+}
+
+/**
+ * Append string data to the buffer. In JSON format quotes, backslashes
+ * and control characters are escaped. 
+ * @param o output stream
+ * @param s string data
+ * @param n length of data
+ * @return 1 on success or 0 on failure
+ */
+static int emit_chars(bsm_out_t * o, const uchar_t * s, int n)
+{
+   static const char hex[] = "0123456789abcdef";
+   emit_t *e = o->emit;
+   int i;
+
+   for (i = 0; i < n; i++) {
+      if (e->len + 6 > EMIT_BUFFER_SIZE && !emit_flush(o))
+	 return 0;
+
+      if (e->format == EMIT_JSON && (s[i] < 0x20 || s[i] == '"' ||
+				     s[i] == '\\')) {
+	 e->buf[e->len++] = '\\';
+	 if (s[i] == '"' || s[i] == '\\') {
+	    e->buf[e->len++] = s[i];
+	 } else {
+	    emit_raw(e, "u00", 3);
+	    e->buf[e->len++] = hex[s[i] >> 4];
+	    e->buf[e->len++] = hex[s[i] & 15];
+	 }
+      } else
+	 e->buf[e->len++] = s[i];
+   }
+
+   return 1;
+}
+
+/**
+ * Emit a string field. The string ends at its length or at the first NUL.
+ * @param o output stream
+ * @param key name of field
+ * @param s string
+ * @param n maximum length of string
+ * @return 1 on success or 0 on failure
+ */
+static int emit_str(bsm_out_t * o, const char *key, const uchar_t * s,
+		    int n)
+{
+   const uchar_t *end;
+   int json = o->emit->format == EMIT_JSON;
+
+   if ((end = memchr(s, 0, n)))
+      n = end - s;
+
+   if (!emit_room(o, EMIT_RESERVE))
+      return 0;
+
+   emit_key(o->emit, key);
+   if (json)
+      o->emit->buf[o->emit->len++] = '"';
+
+   if (!emit_chars(o, s, n) || !emit_room(o, 1))
+      return 0;
+
+   if (json)
+      o->emit->buf[o->emit->len++] = '"';
+   return 1;
+}
+
+/**
+ * Emit a field of raw data in hexadecimal notation.
+ * @param o output stream
+ * @param key name of field
+ * @param s data
+ * @param n length of data
+ * @return 1 on success or 0 on failure
+ */
+static int emit_hex(bsm_out_t * o, const char *key, const uchar_t * s,
+		    int n)
+{
+   static const char hex[] = "0123456789abcdef";
+   emit_t *e = o->emit;
+   int i;
+
+   if (!emit_room(o, EMIT_RESERVE))
+      return 0;
+
+   emit_key(e, key);
+   emit_raw(e, e->format == EMIT_JSON ? "\"0x" : "0x", 
+	    e->format == EMIT_JSON ? 3 : 2);
+
+   for (i = 0; i < n; i++) {
+      if (e->len + 3 > EMIT_BUFFER_SIZE && !emit_flush(o))
+	 return 0;
+      e->buf[e->len++] = hex[s[i] >> 4];
+      e->buf[e->len++] = hex[s[i] & 15];
+   }
+
+   if (e->format == EMIT_JSON)
+      e->buf[e->len++] = '"';
+   return 1;
+}
+
+/**
+ * Emit an inet address field.
+ * @param o output stream
+ * @param key name of field
+ * @param addr address
+ * @param len length of address, either 4 or 16
+ * @return 1 on success or 0 on failure
+ */
+static int emit_addr(bsm_out_t * o, const char *key, const uchar_t * addr,
+		     int len)
+{
+   char tmp[46];
+
+   if (!inet_ntop(len == 16 ? AF_INET6 : AF_INET, addr, tmp, sizeof(tmp)))
+      tmp[0] = 0;
+
+   return emit_str(o, key, (uchar_t *) tmp, sizeof(tmp));
+}
+
+/**
+ * Start a token. An open record is closed before a header and a record is
+ * opened by the header.
+ * @param o output stream
+ * @param name name of token
+ * @param header token starts a record
+ * @return 1 on success or 0 on failure
+ */
+static int emit_begin(bsm_out_t * o, const char *name, int header)
+{
+   emit_t *e = o->emit;
+
+   if (header && e->record && !emit_finish(o))
+      return 0;
+
+   if (!emit_room(o, EMIT_RESERVE))
+      return 0;
+
+   if (e->format == EMIT_JSON) {
+      if (header)
+	 emit_raw(e, "{\"record\":[", 11);
+      else if (e->record && e->tokens)
+	 e->buf[e->len++] = ',';
+      emit_raw(e, "{\"token\":\"", 10);
+      emit_raw(e, name, strlen(name));
+      e->buf[e->len++] = '"';
+   } else
+      emit_raw(e, name, strlen(name));
+
+   if (header)
+      e->record = 1;
+   e->tokens++;
+   return 1;
+}
+
+/**
+ * Finish a token. A trailer closes the open record.
+ * @param o output stream
+ * @param trailer token ends a record
+ * @return 1 on success or 0 on failure
+ */
+static int emit_end(bsm_out_t * o, int trailer)
+{
+   emit_t *e = o->emit;
+
+   if (!emit_room(o, 4))
+      return 0;
+
+   if (e->format == EMIT_JSON) {
+      e->buf[e->len++] = '}';
+      if (!e->record)
+	 e->buf[e->len++] = '\n';
+   } else
+      e->buf[e->len++] = '\n';
+
+   if (!e->record)
+      e->tokens = 0;
+
+   if (trailer && e->record) {
+      if (e->format == EMIT_JSON)
+	 emit_raw(e, "]}\n", 3);
+      e->record = 0;
+      e->tokens = 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Emit the strings of an exec argument or environment token. The strings
+ * may be split across chunks of a streamed token.
+ * @param o output stream
+ * @param s string data
+ * @param n length of data
+ * @return 1 on success or 0 on failure
+ */
+static int emit_strings(bsm_out_t * o, const uchar_t * s, int n)
+{
+   emit_t *e = o->emit;
+   const uchar_t *end;
+   int json = e->format == EMIT_JSON, k;
+
+   while (n > 0) {
+      if (!emit_room(o, 4))
+	 return 0;
+
+      if (!e->in_string) {
+	 if (e->strings || !json)
+	    e->buf[e->len++] = ',';
+	 if (json)
+	    e->buf[e->len++] = '"';
+	 e->in_string = 1;
+	 e->strings++;
+      }
+
+      end = memchr(s, 0, n);
+      k = end ? end - s : n;
+      if (!emit_chars(o, s, k))
+	 return 0;
+
+      if (end) {
+	 if (!emit_room(o, 1))
+	    return 0;
+	 if (json)
+	    e->buf[e->len++] = '"';
+	 e->in_string = 0;
+	 k++;
+      }
+
+      s += k;
+      n -= k;
+   }
+
+   return 1;
+}
+
+/**
+ * Finish an exec argument or environment token.
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+static int emit_strings_end(bsm_out_t * o)
+{
+   emit_t *e = o->emit;
+
+   if (!emit_room(o, 4))
+      return 0;
+
+   if (e->format == EMIT_JSON) {
+      if (e->in_string)
+	 e->buf[e->len++] = '"';
+      e->buf[e->len++] = ']';
+   }
+
+   e->in_string = 0;
+   e->strings = 0;
+   return emit_end(o, 0);
+}
+
+/**
+ * Emit the fields of a subject or process token.
+ * @param o output stream
+ * @param buf token
+ * @param port size of the port field, 4 or 8
+ * @param ex token carries an address type field
+ * @return 1 on success or 0 on failure
+ */
+static int emit_subject(bsm_out_t * o, uchar_t * buf, int port, int ex)
+{
+   int pos = 29 + port, alen = 4;
+
+   if (ex) {
+      alen = field_get32(buf + pos) == AU_IPv6 ? 16 : 4;
+      pos += 4;
+   }
+
+   return emit_uint(o, "auid", field_get32(buf + 1)) &&
+       emit_uint(o, "euid", field_get32(buf + 5)) &&
+       emit_uint(o, "egid", field_get32(buf + 9)) &&
+       emit_uint(o, "ruid", field_get32(buf + 13)) &&
+       emit_uint(o, "rgid", field_get32(buf + 17)) &&
+       emit_uint(o, "pid", field_get32(buf + 21)) &&
+       emit_uint(o, "sid", field_get32(buf + 25)) &&
+       emit_uint(o, "port", port == 8 ? field_get64(buf + 29) :
+		 field_get32(buf + 29)) &&
+       emit_addr(o, "machine", buf + pos, alen);
+}
+
+/**
+ * Emit the fields of a header token.
+ * @param o output stream
+ * @param buf token
+ * @param wide token has 8 byte time fields
+ * @param ex token carries a host address
+ * @return 1 on success or 0 on failure
+ */
+static int emit_header(bsm_out_t * o, uchar_t * buf, int wide, int ex)
+{
+   int pos = 10, alen;
+
+   if (!emit_uint(o, "size", field_get32(buf + 1)) ||
+       !emit_uint(o, "version", buf[5]) ||
+       !emit_uint(o, "event", field_get16(buf + 6)) ||
+       !emit_uint(o, "modifier", field_get16(buf + 8)))
+      return 0;
+
+   if (ex) {
+      alen = field_get32(buf + 10) == AU_IPv6 ? 16 : 4;
+      if (!emit_addr(o, "host", buf + 14, alen))
+	 return 0;
+      pos = 14 + alen;
+   }
+
+   if (wide)
+      return emit_uint(o, "time", field_get64(buf + pos)) &&
+	  emit_uint(o, "msec", field_get64(buf + pos + 8));
+
+   return emit_uint(o, "time", field_get32(buf + pos)) &&
+       emit_uint(o, "msec", field_get32(buf + pos + 4));
+}
+
+/**
+ * Emit the fields of a socket token.
+ * @param o output stream
+ * @param buf token
+ * @param ex token carries a domain and an address type
+ * @return 1 on success or 0 on failure
+ */
+static int emit_socket(bsm_out_t * o, uchar_t * buf, int ex)
+{
+   int alen;
+
+   if (!ex)
+      return emit_uint(o, "type", field_get16(buf + 1)) &&
+	  emit_uint(o, "lport", field_get16(buf + 3)) &&
+	  emit_addr(o, "laddr", buf + 5, 4) &&
+	  emit_uint(o, "rport", field_get16(buf + 9)) &&
+	  emit_addr(o, "raddr", buf + 11, 4);
+
+   alen = field_get16(buf + 5) == AU_IPv6 ? 16 : 4;
+   return emit_uint(o, "domain", field_get16(buf + 1)) &&
+       emit_uint(o, "type", field_get16(buf + 3)) &&
+       emit_uint(o, "lport", field_get16(buf + 7)) &&
+       emit_addr(o, "laddr", buf + 9, alen) &&
+       emit_uint(o, "rport", field_get16(buf + 9 + alen)) &&
+       emit_addr(o, "raddr", buf + 11 + alen, alen);
+}
+
+/**
+ * Look up the name of an output format.
+ * @param name name of format
+ * @return format or -1 if it is unknown
+ */
+int emit_format(char *name)
+{
+   if (!strcmp(name, "bsm"))
+      return EMIT_BSM;
+   if (!strcmp(name, "text"))
+      return EMIT_TEXT;
+   if (!strcmp(name, "json"))
+      return EMIT_JSON;
+
+   return -1;
+}
+
+/**
+ * Create an emitter.
+ * @param format output format
+ * @return emitter or NULL on failure
+ */
+emit_t *emit_create(int format)
+{
+   emit_t *e;
+
+   if (!(e = malloc(sizeof(emit_t))))
+      return NULL;
+
+   e->format = format;
+   e->len = 0;
+   e->record = e->tokens = 0;
+   e->strings = e->in_string = 0;
+   return e;
+}
+
+/**
+ * Format a token and append it to the output buffer. The buffer contains
+ * a pseudonymized token or a chunk of a streamed exec token.
+ * @param o output stream
+ * @param buf buffer containing the token
+ * @param len length of token
+ * @param chunk BSM_CHUNK flags of the token
+ * @return 1 on success or 0 on failure
+ */
+int emit_token(bsm_out_t * o, uchar_t * buf, int len, int chunk)
+{
+   int ret;
+
+   if (chunk & BSM_CHUNK_CONT) {
+      if (!emit_strings(o, buf, len))
+	 return 0;
+      return chunk & BSM_CHUNK_MORE ? 1 : emit_strings_end(o);
+   }
+
+   switch (buf[0]) {
+   case AUT_OTHER_FILE32:
+      ret = emit_begin(o, "file", 0) &&
+	  emit_uint(o, "time", field_get32(buf + 1)) &&
+	  emit_uint(o, "msec", field_get32(buf + 5)) &&
+	  emit_str(o, "name", buf + 11, len - 11);
+      break;
+   case AUT_OTHER_FILE64:
+      ret = emit_begin(o, "file", 0) &&
+	  emit_uint(o, "time", field_get64(buf + 1)) &&
+	  emit_uint(o, "msec", field_get64(buf + 9)) &&
+	  emit_str(o, "name", buf + 19, len - 19);
+      break;
+   case AUT_HEADER32:
+   case AUT_HEADER32_EX:
+   case AUT_HEADER64:
+   case AUT_HEADER64_EX:
+      ret = emit_begin(o, "header", 1) &&
+	  emit_header(o, buf, buf[0] == AUT_HEADER64 ||
+		      buf[0] == AUT_HEADER64_EX,
+		      buf[0] == AUT_HEADER32_EX ||
+		      buf[0] == AUT_HEADER64_EX);
+      break;
+   case AUT_TRAILER:
+      ret = emit_begin(o, "trailer", 0) &&
+	  emit_uint(o, "size", field_get32(buf + 3));
+      return ret && emit_end(o, 1);
+   case AUT_PATH:
+   case AUT_TEXT:
+      ret = emit_begin(o, buf[0] == AUT_PATH ? "path" : "text", 0) &&
+	  emit_str(o, buf[0] == AUT_PATH ? "path" : "text", buf + 3,
+		   len - 3);
+      break;
+   case AUT_SUBJECT32:
+   case AUT_SUBJECT64:
+   case AUT_SUBJECT32_EX:
+   case AUT_SUBJECT64_EX:
+      ret = emit_begin(o, "subject", 0) &&
+	  emit_subject(o, buf, buf[0] == AUT_SUBJECT64 ||
+		       buf[0] == AUT_SUBJECT64_EX ? 8 : 4,
+		       buf[0] == AUT_SUBJECT32_EX ||
+		       buf[0] == AUT_SUBJECT64_EX);
+      break;
+   case AUT_PROCESS32:
+   case AUT_PROCESS64:
+   case AUT_PROCESS32_EX:
+   case AUT_PROCESS64_EX:
+      ret = emit_begin(o, "process", 0) &&
+	  emit_subject(o, buf, buf[0] == AUT_PROCESS64 ||
+		       buf[0] == AUT_PROCESS64_EX ? 8 : 4,
+		       buf[0] == AUT_PROCESS32_EX ||
+		       buf[0] == AUT_PROCESS64_EX);
+      break;
+   case AUT_RETURN32:
+      ret = emit_begin(o, "return", 0) &&
+	  emit_uint(o, "errno", buf[1]) &&
+	  emit_int(o, "value", (int32_t) field_get32(buf + 2));
+      break;
+   case AUT_RETURN64:
+      ret = emit_begin(o, "return", 0) &&
+	  emit_uint(o, "errno", buf[1]) &&
+	  emit_int(o, "value", (int64_t) field_get64(buf + 2));
+      break;
+   case AUT_ARG32:
+      ret = emit_begin(o, "argument", 0) &&
+	  emit_uint(o, "num", buf[1]) &&
+	  emit_uint(o, "value", field_get32(buf + 2)) &&
+	  emit_str(o, "text", buf + 8, len - 8);
+      break;
+   case AUT_ARG64:
+      ret = emit_begin(o, "argument", 0) &&
+	  emit_uint(o, "num", buf[1]) &&
+	  emit_uint(o, "value", field_get64(buf + 2)) &&
+	  emit_str(o, "text", buf + 12, len - 12);
+      break;
+   case AUT_EXEC_ARGS:
+   case AUT_EXEC_ENV:
+      if (!emit_begin(o, buf[0] == AUT_EXEC_ARGS ? "exec_args" :
+		      "exec_env", 0) ||
+	  !emit_uint(o, "count", field_get32(buf + 1)))
+	 return 0;
+
+      /*
+       * The strings follow as an array and are continued by the
+       * chunks of a streamed token.
+       */
+      if (o->emit->format == EMIT_JSON) {
+	 if (!emit_room(o, EMIT_RESERVE))
+	    return 0;
+	 emit_raw(o->emit, ",\"strings\":[", 12);
+      }
+
+      if (!emit_strings(o, buf + 5, len - 5))
+	 return 0;
+      return chunk & BSM_CHUNK_MORE ? 1 : emit_strings_end(o);
+   case AUT_IN_ADDR:
+      ret = emit_begin(o, "ip_addr", 0) &&
+	  emit_addr(o, "addr", buf + 1, 4);
+      break;
+   case AUT_IN_ADDR_EX:
+      ret = emit_begin(o, "ip_addr", 0) &&
+	  emit_addr(o, "addr", buf + 5,
+		    field_get32(buf + 1) == AU_IPv6 ? 16 : 4);
+      break;
+   case AUT_IPORT:
+      ret = emit_begin(o, "ip_port", 0) &&
+	  emit_uint(o, "port", field_get16(buf + 1));
+      break;
+   case AUT_SOCKET:
+   case AUT_SOCKET_EX:
+      ret = emit_begin(o, "socket", 0) &&
+	  emit_socket(o, buf, buf[0] == AUT_SOCKET_EX);
+      break;
+   case AUT_SEQ:
+      ret = emit_begin(o, "sequence", 0) &&
+	  emit_uint(o, "seq", field_get32(buf + 1));
+      break;
+   case AUT_EXIT:
+      ret = emit_begin(o, "exit", 0) &&
+	  emit_int(o, "status", (int32_t) field_get32(buf + 1)) &&
+	  emit_int(o, "value", (int32_t) field_get32(buf + 5));
+      break;
+   case AUT_ATTR32:
+   case AUT_ATTR64:
+      ret = emit_begin(o, "attribute", 0) &&
+	  emit_uint(o, "mode", field_get32(buf + 1)) &&
+	  emit_uint(o, "uid", field_get32(buf + 5)) &&
+	  emit_uint(o, "gid", field_get32(buf + 9)) &&
+	  emit_uint(o, "fsid", field_get32(buf + 13)) &&
+	  emit_uint(o, "nodeid", field_get64(buf + 17)) &&
+	  emit_uint(o, "device", buf[0] == AUT_ATTR64 ?
+		    field_get64(buf + 25) : field_get32(buf + 25));
+      break;
+   case AUT_IPC:
+      ret = emit_begin(o, "IPC", 0) &&
+	  emit_uint(o, "type", buf[1]) &&
+	  emit_uint(o, "id", field_get32(buf + 2));
+      break;
+   case AUT_IPC_PERM:
+      ret = emit_begin(o, "IPC_perm", 0) &&
+	  emit_uint(o, "uid", field_get32(buf + 1)) &&
+	  emit_uint(o, "gid", field_get32(buf + 5)) &&
+	  emit_uint(o, "cuid", field_get32(buf + 9)) &&
+	  emit_uint(o, "cgid", field_get32(buf + 13)) &&
+	  emit_uint(o, "mode", field_get32(buf + 17)) &&
+	  emit_uint(o, "seq", field_get32(buf + 21)) &&
+	  emit_uint(o, "key", field_get32(buf + 25));
+      break;
+   default:
+      /*
+       * Other tokens are emitted as raw data.
+       */
+      ret = emit_begin(o, "token", 0) &&
+	  emit_uint(o, "id", buf[0]) &&
+	  emit_hex(o, "data", buf + 1, len - 1);
+      break;
+   }
+
+   return ret && emit_end(o, 0);
+}
+
+/**
+ * Close an open record and write the buffer to the output stream. A
+ * record without trailer is closed as it is.
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+int emit_finish(bsm_out_t * o)
+{
+   emit_t *e = o->emit;
+
+   if (e->record) {
+      if (!emit_room(o, 4))
+	 return 0;
+      if (e->format == EMIT_JSON)
+	 emit_raw(e, "]}\n", 3);
+      e->record = 0;
+      e->tokens = 0;
+   }
+
+   return emit_flush(o);
+}
@@ -0,0 +1,59 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file emit.h Text and JSON emitter header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _EMIT_H
+#define _EMIT_H
+
+#define EMIT_BSM          0		/**< Binary BSM output */
+#define EMIT_TEXT         1		/**< praudit(1M)-style text output */
+#define EMIT_JSON         2		/**< One JSON object per record */
+
+#define EMIT_BUFFER_SIZE  (1 << 20)	/**< Size of output buffer */
+#define EMIT_RESERVE      256		/**< Space reserved for a field */
+
+/**
+ * State of an emitter. Tokens are formatted into a large buffer that is
+ * written to the output stream when it is full. Streamed exec tokens are
+ * formatted chunk by chunk, so the position within their strings is kept.
+ */
+typedef struct s_emit {
+   int format;			     /**< Output format */
+   int len;			     /**< Bytes used in buffer */
+   int record;			     /**< A record is open */
+   int tokens;			     /**< Tokens emitted in open record */
+   int strings;			     /**< Strings emitted in exec token */
+   int in_string;		     /**< Within a string of exec token */
+   char buf[EMIT_BUFFER_SIZE];	     /**< Output buffer */
+} emit_t;
+
+int emit_format(char *name);
+emit_t *emit_create(int format);
+int emit_token(bsm_out_t * o, uchar_t * buf, int len, int chunk);
+int emit_finish(bsm_out_t * o);
+
+#endif				/* _EMIT_H */
@@ -0,0 +1,132 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file field.h Access to the fields of BSM tokens.
+ * BSM audit trails are stored in network byte order, independent of the
+ * host that has written them. All multi-byte fields of tokens are decoded
+ * and encoded using the inline functions of this header, so that trails
+ * from big-endian hosts can be processed on little-endian hosts and vice
+ * versa. Fields need not be aligned.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _FIELD_H
+#define _FIELD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#if defined(_BIG_ENDIAN) || defined(WORDS_BIGENDIAN)
+#define FIELD_SWAP16(x)  (x)
+#define FIELD_SWAP32(x)  (x)
+#define FIELD_SWAP64(x)  (x)
+#elif defined(__GNUC__)
+#define FIELD_SWAP16(x)  __builtin_bswap16(x)
+#define FIELD_SWAP32(x)  __builtin_bswap32(x)
+#define FIELD_SWAP64(x)  __builtin_bswap64(x)
+#else
+#define FIELD_SWAP16(x)  ((uint16_t) (((x) >> 8) | ((x) << 8)))
+#define FIELD_SWAP32(x)  ((((x) & 0xff000000U) >> 24) | \
+                          (((x) & 0x00ff0000U) >> 8) | \
+                          (((x) & 0x0000ff00U) << 8) | \
+                          (((x) & 0x000000ffU) << 24))
+#define FIELD_SWAP64(x)  (((uint64_t) FIELD_SWAP32((uint32_t) (x)) << 32) | \
+                          FIELD_SWAP32((uint32_t) ((x) >> 32)))
+#endif
+
+/**
+ * Decode a 2 byte field.
+ * @param b Pointer to field
+ * @return value of field
+ */
+static inline uint16_t field_get16(const unsigned char *b)
+{
+   uint16_t v;
+
+   memcpy(&v, b, sizeof(v));
+   return FIELD_SWAP16(v);
+}
+
+/**
+ * Decode a 4 byte field.
+ * @param b Pointer to field
+ * @return value of field
+ */
+static inline uint32_t field_get32(const unsigned char *b)
+{
+   uint32_t v;
+
+   memcpy(&v, b, sizeof(v));
+   return FIELD_SWAP32(v);
+}
+
+/**
+ * Decode an 8 byte field.
+ * @param b Pointer to field
+ * @return value of field
+ */
+static inline uint64_t field_get64(const unsigned char *b)
+{
+   uint64_t v;
+
+   memcpy(&v, b, sizeof(v));
+   return FIELD_SWAP64(v);
+}
+
+/**
+ * Encode a 2 byte field.
+ * @param b Pointer to field
+ * @param v value of field
+ */
+static inline void field_put16(unsigned char *b, uint16_t v)
+{
+   v = FIELD_SWAP16(v);
+   memcpy(b, &v, sizeof(v));
+}
+
+/**
+ * Encode a 4 byte field.
+ * @param b Pointer to field
+ * @param v value of field
+ */
+static inline void field_put32(unsigned char *b, uint32_t v)
+{
+   v = FIELD_SWAP32(v);
+   memcpy(b, &v, sizeof(v));
+}
+
+/**
+ * Encode an 8 byte field.
+ * @param b Pointer to field
+ * @param v value of field
+ */
+static inline void field_put64(unsigned char *b, uint64_t v)
+{
+   v = FIELD_SWAP64(v);
+   memcpy(b, &v, sizeof(v));
+}
+
+#endif				/* _FIELD_H */
@@ -0,0 +1,417 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file filter.c Record filter.
+ * Records can be selected by their event type, by the audit classes of
+ * their event type and by the audit user ID of their subject. The filter is
+ * applied when the header of a record is read, before any token of the
+ * record is pseudonymized. Rejected records are skipped as a whole using
+ * the byte count of the header, so that their tokens are neither parsed,
+ * nor written, nor do their fields enter the mapping tables.
+ *
+ * Event and class names are resolved using the audit_event(4) and
+ * audit_class(4) databases. Records are kept if their event type is
+ * selected by an event or by a class and if their audit user ID is one of
+ * the selected uids.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pwd.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "bsm.h"
+#include "filter.h"
+#include "config.h"
+
+#define EVENT_SET(e)    (events[(e) >> 5] |= 1U << ((e) & 31))
+#define EVENT_TEST(e)   (events[(e) >> 5] & (1U << ((e) & 31)))
+
+/**
+ * Entry of the class database.
+ */
+typedef struct {
+   char name[32];			/**< Name of class */
+   uint32_t mask;			/**< Mask of class */
+} filter_class_t;
+
+static uint32_t *events = NULL;		/**< Bitmap of selected events */
+static uid_t *uids = NULL;		/**< Selected audit uids */
+static int nuids = 0;			/**< Number of selected uids */
+
+/**
+ * Allocate the bitmap of selected events.
+ * @return 1 on success or 0 on failure
+ */
+static int filter_alloc()
+{
+   if (events)
+      return 1;
+
+   events = calloc(FILTER_EVENTS / 32, sizeof(uint32_t));
+   if (!events) {
+      err_msg("Failed to allocate memory");
+      return 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Split a line of an audit database into its colon-separated fields.
+ * Comments and lines with too few fields are rejected.
+ * @param line line, modified in place
+ * @param fields array receiving the fields
+ * @param n number of fields to split
+ * @return 1 on success or 0 if the line holds no entry
+ */
+static int filter_split(char *line, char **fields, int n)
+{
+   int i;
+
+   line[strcspn(line, "\n")] = 0;
+   if (line[0] == '#' || !line[0])
+      return 0;
+
+   for (i = 0; i < n; i++) {
+      fields[i] = line;
+      line = strchr(line, ':');
+      if (!line)
+	 return i == n - 1;
+      *line++ = 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Look up an event type in the event database. Names are accepted with
+ * and without the AUE_ prefix.
+ * @param name name or number of event
+ * @return event type or -1 if it is unknown
+ */
+static long filter_event(char *name)
+{
+   char line[1024], *f[4], *end;
+   long event = -1;
+   FILE *fp;
+
+   event = strtol(name, &end, 0);
+   if (!*end)
+      return event >= 0 && event < FILTER_EVENTS ? event : -1;
+
+   if (!(fp = fopen(FILTER_EVENT_FILE, "r"))) {
+      err_msg("Could not open %s", FILTER_EVENT_FILE);
+      return -1;
+   }
+
+   event = -1;
+   while (event < 0 && fgets(line, sizeof(line), fp)) {
+      if (!filter_split(line, f, 2))
+	 continue;
+
+      if (!strcmp(f[1], name) ||
+	  (!strncmp(f[1], "AUE_", 4) && !strcmp(f[1] + 4, name)))
+	 event = strtol(f[0], NULL, 0);
+   }
+   fclose(fp);
+
+   if (event < 0 || event >= FILTER_EVENTS)
+      err_msg("Unknown event %s", name);
+
+   return event < FILTER_EVENTS ? event : -1;
+}
+
+/**
+ * Load the class database.
+ * @param n receives the number of classes
+ * @return array of classes or NULL on failure
+ */
+static filter_class_t *filter_load_classes(int *n)
+{
+   char line[1024], *f[3];
+   filter_class_t *classes = NULL, *tmp;
+   FILE *fp;
+
+   if (!(fp = fopen(FILTER_CLASS_FILE, "r"))) {
+      err_msg("Could not open %s", FILTER_CLASS_FILE);
+      return NULL;
+   }
+
+   *n = 0;
+   while (fgets(line, sizeof(line), fp)) {
+      if (!filter_split(line, f, 2))
+	 continue;
+
+      tmp = realloc(classes, (*n + 1) * sizeof(filter_class_t));
+      if (!tmp) {
+	 err_msg("Failed to allocate memory");
+	 break;
+      }
+      classes = tmp;
+      snprintf(classes[*n].name, sizeof(classes[*n].name), "%s", f[1]);
+      classes[*n].mask = strtoul(f[0], NULL, 0);
+      (*n)++;
+   }
+   fclose(fp);
+
+   if (!*n) {
+      free(classes);
+      return NULL;
+   }
+
+   return classes;
+}
+
+/**
+ * Look up the mask of an audit class.
+ * @param classes array of classes
+ * @param n number of classes
+ * @param name name of class
+ * @return mask of class or 0 if it is unknown
+ */
+static uint32_t filter_class(filter_class_t * classes, int n, char *name)
+{
+   int i;
+
+   for (i = 0; i < n; i++)
+      if (!strcmp(classes[i].name, name))
+	 return classes[i].mask;
+
+   return 0;
+}
+
+/**
+ * Select events by type. 
+ * @param list comma-separated list of event names or numbers
+ * @return 1 on success or 0 on failure
+ */
+int filter_events(char *list)
+{
+   char *str;
+   long event;
+
+   if (!filter_alloc())
+      return 0;
+
+   for (str = strtok(list, ","); str; str = strtok(NULL, ",")) {
+      if ((event = filter_event(str)) < 0)
+	 return 0;
+      EVENT_SET(event);
+   }
+
+   return 1;
+}
+
+/**
+ * Select events by audit class. All events of the event database that
+ * belong to one of the classes are selected.
+ * @param list comma-separated list of class names
+ * @return 1 on success or 0 on failure
+ */
+int filter_classes(char *list)
+{
+   char line[1024], *f[4], *str, *c;
+   filter_class_t *classes;
+   uint32_t mask = 0, m;
+   long event;
+   int n, ret = 0;
+   FILE *fp;
+
+   if (!filter_alloc() || !(classes = filter_load_classes(&n)))
+      return 0;
+
+   for (str = strtok(list, ","); str; str = strtok(NULL, ",")) {
+      if (!(m = filter_class(classes, n, str))) {
+	 err_msg("Unknown audit class %s", str);
+	 goto out;
+      }
+      mask |= m;
+   }
+
+   if (!(fp = fopen(FILTER_EVENT_FILE, "r"))) {
+      err_msg("Could not open %s", FILTER_EVENT_FILE);
+      goto out;
+   }
+
+   /*
+    * The last field of an event lists the classes of the event.
+    */
+   while (fgets(line, sizeof(line), fp)) {
+      if (!filter_split(line, f, 4))
+	 continue;
+
+      event = strtol(f[0], NULL, 0);
+      if (event < 0 || event >= FILTER_EVENTS)
+	 continue;
+
+      m = 0;
+      for (c = strtok(f[3], ","); c; c = strtok(NULL, ","))
+	 m |= filter_class(classes, n, c);
+
+      if (m & mask)
+	 EVENT_SET(event);
+   }
+   fclose(fp);
+   ret = 1;
+
+ out:
+   free(classes);
+   return ret;
+}
+
+/**
+ * Select records by the audit user ID of their subject.
+ * @param list comma-separated list of user names or uids
+ * @return 1 on success or 0 on failure
+ */
+int filter_uids(char *list)
+{
+   struct passwd *pw;
+   char *str, *end;
+   uid_t *tmp, uid;
+
+   for (str = strtok(list, ","); str; str = strtok(NULL, ",")) {
+      uid = strtoul(str, &end, 10);
+      if (*end) {
+	 if (!(pw = getpwnam(str))) {
+	    err_msg("Unknown user %s", str);
+	    return 0;
+	 }
+	 uid = pw->pw_uid;
+      }
+
+      tmp = realloc(uids, (nuids + 1) * sizeof(uid_t));
+      if (!tmp) {
+	 err_msg("Failed to allocate memory");
+	 return 0;
+      }
+      uids = tmp;
+      uids[nuids++] = uid;
+   }
+
+   return 1;
+}
+
+/**
+ * Build a table mapping each event type to the first of its audit classes.
+ * Classes are numbered in the order of the class database. Events without
+ * a known class are mapped to the number of classes.
+ * @return table of FILTER_EVENTS entries or NULL on failure
+ */
+ushort_t *filter_class_table()
+{
+   char line[1024], *f[4], *c;
+   filter_class_t *classes;
+   ushort_t *table;
+   long event;
+   int i, n;
+   FILE *fp;
+
+   if (!(classes = filter_load_classes(&n)))
+      return NULL;
+
+   if (!(table = malloc(FILTER_EVENTS * sizeof(ushort_t)))) {
+      err_msg("Failed to allocate memory");
+      free(classes);
+      return NULL;
+   }
+
+   for (event = 0; event < FILTER_EVENTS; event++)
+      table[event] = n;
+
+   if (!(fp = fopen(FILTER_EVENT_FILE, "r"))) {
+      err_msg("Could not open %s", FILTER_EVENT_FILE);
+      free(classes);
+      free(table);
+      return NULL;
+   }
+
+   while (fgets(line, sizeof(line), fp)) {
+      if (!filter_split(line, f, 4))
+	 continue;
+
+      event = strtol(f[0], NULL, 0);
+      if (event < 0 || event >= FILTER_EVENTS)
+	 continue;
+
+      c = strtok(f[3], ",");
+      for (i = 0; c && i < n; i++)
+	 if (!strcmp(classes[i].name, c)) {
+	    table[event] = i;
+	    break;
+	 }
+   }
+   fclose(fp);
+
+   free(classes);
+   return table;
+}
+
+/**
+ * Decide whether a record is kept. The stream has to be positioned at the
+ * header of the record. Records without a subject are rejected by the uid
+ * filter, records too large to be searched for their subject are kept.
+ * @param s stream
+ * @return 1 if the record is kept or 0 if it is rejected
+ */
+int filter_record(bsm_stream_t * s)
+{
+   uint32_t auid;
+   int i, ret;
+
+   if (events && !EVENT_TEST(read_short(s, 6)))
+      return 0;
+
+   if (!nuids)
+      return 1;
+
+   if ((ret = bsm_subject(s, &auid)) <= 0)
+      return ret < 0;
+
+   for (i = 0; i < nuids; i++)
+      if (uids[i] == auid)
+	 return 1;
+
+   return 0;
+}
+
+/**
+ * Free the memory of the filter.
+ */
+void filter_deinit()
+{
+   free(events);
+   free(uids);
+   events = NULL;
+   uids = NULL;
+   nuids = 0;
+}
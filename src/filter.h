@@ -0,0 +1,43 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file filter.h Record filter header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#define FILTER_EVENT_FILE  "/etc/security/audit_event"	/**< Event database */
+#define FILTER_CLASS_FILE  "/etc/security/audit_class"	/**< Class database */
+#define FILTER_EVENTS      65536	/**< Number of event types */
+
+int filter_events(char *list);
+int filter_classes(char *list);
+int filter_uids(char *list);
+int filter_record(bsm_stream_t * s);
+ushort_t *filter_class_table();
+void filter_deinit();
+
+#endif				/* _FILTER_H */
@@ -290,9 +290,11 @@ static int ht_insert_internal(hash_table_t * p_ht,
    }
    p_entry->i_flags = i_flags;
 
-   /* Rehash if the number of items inserted is too high. */
+   /* Rehash if the number of items inserted is too high. The bucket
+    * changes with the size of the table. */
    if (p_ht->i_automatic_rehash && p_ht->i_items > 2 * p_ht->i_size) {
       hash_rehash(p_ht, 2 * p_ht->i_size);
+      l_key = p_ht->fn_hash(&key) & p_ht->i_size_mask;
    }
 
    /* Place the entry first in the list. */
@@ -568,9 +570,6 @@ void hash_finalize(hash_table_t * p_ht)
 
 /* Rehash the hash table (i.e. change its size and reinsert all
  * items). This operation is slow and should not be used frequently.
- *
- * FIXME: Does this work correctly? I think so, but I cannot give any
- * guarantees.
  */
 void hash_rehash(hash_table_t * p_ht, unsigned int i_size)
 {
@@ -598,8 +597,9 @@ void hash_rehash(hash_table_t * p_ht, unsigned int i_size)
 	 fprintf(stderr,
 		 "hash_table.c ERROR: Out of memory error or entry already in hash table\n"
 		 "when rehashing (internal error)\n");
+      } else {
+	 p_tmp->i_items++;
       }
-      p_tmp->i_items++;
    }
 
    /* Remove the old table... */
@@ -0,0 +1,121 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file hll.c HyperLogLog sketches.
+ * The sketches estimate the number of distinct elements of a stream using
+ * a fixed amount of memory. They are used to estimate the number of
+ * distinct uids, pids, pathnames, etc. before the mapping tables are
+ * created.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "hll.h"
+#include "config.h"
+
+/**
+ * Compute a 64 bit hash value. FNV-1a is used for the bytes followed by
+ * the finalizer of MurmurHash3 to spread the bits.
+ * @param data data to hash
+ * @param len length of data
+ * @return hash value
+ */
+static unsigned long long hll_hash(unsigned char *data, unsigned int len)
+{
+   unsigned long long h = 0xcbf29ce484222325ULL;
+   unsigned int i;
+
+   for (i = 0; i < len; i++) {
+      h ^= data[i];
+      h *= 0x100000001b3ULL;
+   }
+
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+
+   return h;
+}
+
+/**
+ * Clear a sketch.
+ * @param h sketch
+ */
+void hll_init(hll_t * h)
+{
+   memset(h->reg, 0, HLL_SIZE);
+}
+
+/**
+ * Add an element to a sketch. The upper bits of the hash select a
+ * register, which keeps the maximum position of the first set bit in the
+ * remaining bits.
+ * @param h sketch
+ * @param data element
+ * @param len length of element
+ */
+void hll_add(hll_t * h, void *data, unsigned int len)
+{
+   unsigned long long x;
+   unsigned int i;
+   unsigned char r;
+
+   x = hll_hash(data, len);
+   i = x >> (64 - HLL_BITS);
+   x <<= HLL_BITS;
+
+   for (r = 1; r <= 64 - HLL_BITS && !(x & (1ULL << 63)); r++)
+      x <<= 1;
+
+   if (r > h->reg[i])
+      h->reg[i] = r;
+}
+
+/**
+ * Estimate the number of distinct elements added to a sketch. Small
+ * cardinalities are estimated by linear counting of empty registers.
+ * @param h sketch
+ * @return estimated number of distinct elements
+ */
+double hll_count(hll_t * h)
+{
+   double sum = 0, e, m = HLL_SIZE;
+   unsigned int i, zeros = 0;
+
+   for (i = 0; i < HLL_SIZE; i++) {
+      sum += ldexp(1.0, -h->reg[i]);
+      if (!h->reg[i])
+	 zeros++;
+   }
+
+   e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+   if (e <= 2.5 * m && zeros)
+      e = m * log(m / zeros);
+
+   return e;
+}
@@ -0,0 +1,47 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file hll.h HyperLogLog sketch header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _HLL_H
+#define _HLL_H
+
+#define HLL_BITS        12		/**< Bits used to select a register */
+#define HLL_SIZE        (1 << HLL_BITS)	/**< Number of registers */
+
+/**
+ * HyperLogLog sketch. The standard error of the estimate is about
+ * 1.04 / sqrt(HLL_SIZE), i.e. 1.6%.
+ */
+typedef struct {
+   unsigned char reg[HLL_SIZE];	     /**< Registers */
+} hll_t;
+
+void hll_init(hll_t * h);
+void hll_add(hll_t * h, void *data, unsigned int len);
+double hll_count(hll_t * h);
+
+#endif				/* _HLL_H */
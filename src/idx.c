@@ -0,0 +1,201 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file idx.c Sidecar index.
+ * An index file can be written alongside the output, so that records can
+ * be located by their pseudonymized time or their sequence number without
+ * reading the whole output. The output is divided into blocks of at least
+ * IDX_BLOCK bytes that start at record boundaries. With compression, each
+ * block is written as a gzip member of its own and can be decompressed
+ * without the data before it.
+ *
+ * The index starts with IDX_MAGIC, the block size and a flag for
+ * compression (4 bytes each), followed by one entry per block. An entry
+ * holds the uncompressed offset, the compressed offset, the first record,
+ * the number of records and the earliest and the latest record time of a
+ * block, 8 bytes each in network byte order. Compressed offsets are
+ * IDX_UNKNOWN if the output is not seekable.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "field.h"
+#include "bsm.h"
+#include "idx.h"
+#include "config.h"
+
+/**
+ * Determine the position of the compressed output.
+ * @param o output stream
+ * @return offset relative to the start of the output or IDX_UNKNOWN
+ */
+static uint64_t idx_zoffset(bsm_out_t * o)
+{
+   long long pos;
+
+   if (!o->zout)
+      return o->offset;
+
+   if (o->idx->zbase < 0 || (pos = lseek(o->fd, 0, SEEK_CUR)) < 0)
+      return IDX_UNKNOWN;
+
+   return pos - o->idx->zbase;
+}
+
+/**
+ * Write the entry of the current block.
+ * @param x index
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+static int idx_entry(bsm_out_t * o)
+{
+   idx_t *x = o->idx;
+   uchar_t e[IDX_ENTRY_SIZE];
+
+   field_put64(e, x->offset);
+   field_put64(e + 8, x->zoffset);
+   field_put64(e + 16, x->first);
+   field_put64(e + 24, x->record - x->first);
+   field_put64(e + 32, x->tmin);
+   field_put64(e + 40, x->tmax);
+
+   if (fwrite(e, sizeof(e), 1, x->fp) != 1) {
+      err_msg("Could not write index");
+      return 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Create an index for an output stream.
+ * @param o output stream
+ * @param name name of index file
+ * @return index or NULL on failure
+ */
+idx_t *idx_open(bsm_out_t * o, char *name)
+{
+   uchar_t h[IDX_HEADER_SIZE];
+   idx_t *x;
+
+   if (!(x = calloc(1, sizeof(idx_t)))) {
+      err_msg("Failed to allocate memory");
+      return NULL;
+   }
+
+   if (!(x->fp = fopen(name, "wb"))) {
+      err_msg("Could not open %s", name);
+      free(x);
+      return NULL;
+   }
+
+   memcpy(h, IDX_MAGIC, 8);
+   field_put32(h + 8, IDX_BLOCK);
+   field_put32(h + 12, o->zout != NULL);
+   fwrite(h, sizeof(h), 1, x->fp);
+
+   x->zbase = lseek(o->fd, 0, SEEK_CUR);
+   return x;
+}
+
+/**
+ * Account a record that is about to be written. If the current block is
+ * large enough, its entry is written and a new block is started with the
+ * record. With compression, the current gzip member is finished, so that
+ * the new block starts a new member.
+ * @param o output stream
+ * @param time pseudonymized time of the record
+ * @return 1 on success or 0 on failure
+ */
+int idx_record(bsm_out_t * o, uint64_t time)
+{
+   idx_t *x = o->idx;
+
+   if (x->open && o->offset - x->offset >= IDX_BLOCK) {
+      if (!idx_entry(o))
+	 return 0;
+      x->open = 0;
+   }
+
+   if (!x->open) {
+      /*
+       * Data before the block, e.g. a file token, ends up in a member
+       * of its own.
+       */
+      if (o->zout && o->offset > x->member &&
+	  gzflush(o->zout, Z_FINISH) != Z_OK) {
+	 err_msg("gzflush");
+	 return 0;
+      }
+
+      x->member = o->offset;
+      x->offset = o->offset;
+      x->zoffset = idx_zoffset(o);
+      x->first = x->record;
+      x->tmin = x->tmax = time;
+      x->open = 1;
+   }
+
+   if (time < x->tmin)
+      x->tmin = time;
+   if (time > x->tmax)
+      x->tmax = time;
+
+   x->record++;
+   return 1;
+}
+
+/**
+ * Write the entry of the last block and close the index.
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+int idx_close(bsm_out_t * o)
+{
+   idx_t *x = o->idx;
+   int ret = 1;
+
+   if (x->open && !idx_entry(o))
+      ret = 0;
+
+   if (fclose(x->fp)) {
+      err_msg("Could not write index");
+      ret = 0;
+   }
+
+   free(x);
+   o->idx = NULL;
+   return ret;
+}
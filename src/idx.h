@@ -0,0 +1,61 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file idx.h Sidecar index header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _IDX_H
+#define _IDX_H
+
+#define IDX_MAGIC         "BSMIDX\0\1"	/**< Magic of index files */
+#define IDX_HEADER_SIZE   16		/**< Size of file header */
+#define IDX_ENTRY_SIZE    48		/**< Size of an entry */
+#define IDX_BLOCK         (1 << 20)	/**< Minimum size of a block */
+#define IDX_UNKNOWN       0xffffffffffffffffULL	/**< Unknown offset */
+
+/**
+ * State of an index writer. The output is divided into blocks of whole
+ * records. For each block an entry is written holding its offset in the
+ * uncompressed and compressed output, its first record, its number of
+ * records and its range of record times.
+ */
+typedef struct s_idx {
+   FILE *fp;			     /**< Index file */
+   long long zbase;		     /**< Position of output at start */
+   uint64_t member;		     /**< Offset of current gzip member */
+   uint64_t offset;		     /**< Offset of current block */
+   uint64_t zoffset;		     /**< Compressed offset of block */
+   uint64_t record;		     /**< Sequence number of next record */
+   uint64_t first;		     /**< First record of current block */
+   uint64_t tmin;		     /**< Earliest time in block */
+   uint64_t tmax;		     /**< Latest time in block */
+   int open;			     /**< Block holds records */
+} idx_t;
+
+idx_t *idx_open(bsm_out_t * o, char *name);
+int idx_record(bsm_out_t * o, uint64_t time);
+int idx_close(bsm_out_t * o);
+
+#endif				/* _IDX_H */
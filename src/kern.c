@@ -0,0 +1,352 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file kern.c String kernels.
+ * Exec argument and environment tokens consist of many NUL-terminated
+ * strings and may be hundreds of kilobytes large. The kernels in this file
+ * process such strings a vector at a time. They are also used to search
+ * for record headers when resynchronizing a corrupt stream. On x86 an
+ * SSE2 version is always compiled and an AVX2 version is selected at
+ * runtime if the processor supports it. On all other platforms a scalar
+ * version is used.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <string.h>
+
+#include "kern.h"
+#include "config.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define KERN_SSE2
+#include <emmintrin.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define KERN_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+/**
+ * Consume NUL terminators from a bitmask of NUL positions. If the mask
+ * holds at least *n terminators, the position after the n-th terminator is
+ * returned and *n becomes 0. Otherwise *n is decreased by the number of
+ * terminators and -1 is returned.
+ * @param mask bitmask of NUL positions
+ * @param n number of terminators still to be found
+ * @return position after the n-th terminator or -1
+ */
+static inline int kern_mask(unsigned int mask, unsigned int *n)
+{
+   unsigned int c = __builtin_popcount(mask);
+
+   if (c < *n) {
+      *n -= c;
+      return -1;
+   }
+
+   while (--*n)
+      mask &= mask - 1;
+
+   return __builtin_ctz(mask) + 1;
+}
+
+/**
+ * Scalar version of kern_skip_nuls().
+ * @param p bytes
+ * @param len number of bytes
+ * @param n number of terminators to find
+ * @return number of consumed bytes
+ */
+static int kern_skip_nuls_scalar(unsigned char *p, int len, unsigned int *n)
+{
+   int i;
+
+   for (i = 0; i < len && *n; i++)
+      if (!p[i])
+	 (*n)--;
+
+   return i;
+}
+
+/**
+ * Scalar version of kern_blank().
+ * @param p bytes
+ * @param len number of bytes
+ */
+static void kern_blank_scalar(unsigned char *p, int len)
+{
+   int i;
+
+   for (i = 0; i < len; i++)
+      if (p[i])
+	 p[i] = ' ';
+}
+
+/**
+ * Scalar version of kern_find().
+ * @param p bytes
+ * @param len number of bytes
+ * @param a first byte to find
+ * @param b second byte to find
+ * @return position of first match or len
+ */
+static int kern_find_scalar(unsigned char *p, int len, unsigned char a,
+			    unsigned char b)
+{
+   int i;
+
+   for (i = 0; i < len; i++)
+      if (p[i] == a || p[i] == b)
+	 return i;
+
+   return len;
+}
+
+#ifdef KERN_SSE2
+/**
+ * SSE2 version of kern_skip_nuls().
+ * @param p bytes
+ * @param len number of bytes
+ * @param n number of terminators to find
+ * @return number of consumed bytes
+ */
+static int kern_skip_nuls_sse2(unsigned char *p, int len, unsigned int *n)
+{
+   __m128i zero = _mm_setzero_si128();
+   unsigned int mask;
+   int i, r;
+
+   for (i = 0; i + 16 <= len && *n; i += 16) {
+      mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			       _mm_loadu_si128((__m128i *) (p + i)), zero));
+      if ((r = kern_mask(mask, n)) >= 0)
+	 return i + r;
+   }
+
+   return i + kern_skip_nuls_scalar(p + i, len - i, n);
+}
+
+/**
+ * SSE2 version of kern_blank().
+ * @param p bytes
+ * @param len number of bytes
+ */
+static void kern_blank_sse2(unsigned char *p, int len)
+{
+   __m128i zero = _mm_setzero_si128(), blank = _mm_set1_epi8(' '), v;
+   int i;
+
+   for (i = 0; i + 16 <= len; i += 16) {
+      v = _mm_loadu_si128((__m128i *) (p + i));
+      v = _mm_andnot_si128(_mm_cmpeq_epi8(v, zero), blank);
+      _mm_storeu_si128((__m128i *) (p + i), v);
+   }
+
+   kern_blank_scalar(p + i, len - i);
+}
+
+/**
+ * SSE2 version of kern_find().
+ * @param p bytes
+ * @param len number of bytes
+ * @param a first byte to find
+ * @param b second byte to find
+ * @return position of first match or len
+ */
+static int kern_find_sse2(unsigned char *p, int len, unsigned char a,
+			  unsigned char b)
+{
+   __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), v;
+   unsigned int mask;
+   int i;
+
+   for (i = 0; i + 16 <= len; i += 16) {
+      v = _mm_loadu_si128((__m128i *) (p + i));
+      mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+					    _mm_cmpeq_epi8(v, vb)));
+      if (mask)
+	 return i + __builtin_ctz(mask);
+   }
+
+   return i + kern_find_scalar(p + i, len - i, a, b);
+}
+#endif
+
+#ifdef KERN_AVX2
+/**
+ * AVX2 version of kern_skip_nuls().
+ * @param p bytes
+ * @param len number of bytes
+ * @param n number of terminators to find
+ * @return number of consumed bytes
+ */
+__attribute__ ((target("avx2")))
+static int kern_skip_nuls_avx2(unsigned char *p, int len, unsigned int *n)
+{
+   __m256i zero = _mm256_setzero_si256();
+   unsigned int mask;
+   int i, r;
+
+   for (i = 0; i + 32 <= len && *n; i += 32) {
+      mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+				  _mm256_loadu_si256((__m256i *) (p + i)),
+				  zero));
+      if ((r = kern_mask(mask, n)) >= 0)
+	 return i + r;
+   }
+
+   return i + kern_skip_nuls_sse2(p + i, len - i, n);
+}
+
+/**
+ * AVX2 version of kern_blank().
+ * @param p bytes
+ * @param len number of bytes
+ */
+__attribute__ ((target("avx2")))
+static void kern_blank_avx2(unsigned char *p, int len)
+{
+   __m256i zero = _mm256_setzero_si256(), blank = _mm256_set1_epi8(' '), v;
+   int i;
+
+   for (i = 0; i + 32 <= len; i += 32) {
+      v = _mm256_loadu_si256((__m256i *) (p + i));
+      v = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, zero), blank);
+      _mm256_storeu_si256((__m256i *) (p + i), v);
+   }
+
+   kern_blank_sse2(p + i, len - i);
+}
+
+/**
+ * AVX2 version of kern_find().
+ * @param p bytes
+ * @param len number of bytes
+ * @param a first byte to find
+ * @param b second byte to find
+ * @return position of first match or len
+ */
+__attribute__ ((target("avx2")))
+static int kern_find_avx2(unsigned char *p, int len, unsigned char a,
+			  unsigned char b)
+{
+   __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), v;
+   unsigned int mask;
+   int i;
+
+   for (i = 0; i + 32 <= len; i += 32) {
+      v = _mm256_loadu_si256((__m256i *) (p + i));
+      mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va),
+						  _mm256_cmpeq_epi8(v, vb)));
+      if (mask)
+	 return i + __builtin_ctz(mask);
+   }
+
+   return i + kern_find_sse2(p + i, len - i, a, b);
+}
+
+/**
+ * Check once whether the processor supports AVX2.
+ * @return 1 if AVX2 is supported or 0 otherwise
+ */
+static int kern_avx2()
+{
+   static int avx2 = -1;
+
+   if (avx2 < 0) {
+      __builtin_cpu_init();
+      avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+   }
+
+   return avx2;
+}
+#endif
+
+/**
+ * Skip NUL-terminated strings. The bytes are scanned until n terminators
+ * have been found or the end of the bytes is reached. The number of
+ * terminators still to be found is returned in n, so that a sequence of
+ * strings can be scanned in several parts.
+ * @param p bytes
+ * @param len number of bytes
+ * @param n number of terminators to find, updated
+ * @return number of consumed bytes including the n-th terminator
+ */
+int kern_skip_nuls(unsigned char *p, int len, unsigned int *n)
+{
+   if (!*n)
+      return 0;
+
+#ifdef KERN_AVX2
+   if (kern_avx2())
+      return kern_skip_nuls_avx2(p, len, n);
+#endif
+#ifdef KERN_SSE2
+   return kern_skip_nuls_sse2(p, len, n);
+#else
+   return kern_skip_nuls_scalar(p, len, n);
+#endif
+}
+
+/**
+ * Blank strings. All bytes except the NUL terminators are replaced with
+ * spaces.
+ * @param p bytes
+ * @param len number of bytes
+ */
+void kern_blank(unsigned char *p, int len)
+{
+#ifdef KERN_AVX2
+   if (kern_avx2()) {
+      kern_blank_avx2(p, len);
+      return;
+   }
+#endif
+#ifdef KERN_SSE2
+   kern_blank_sse2(p, len);
+#else
+   kern_blank_scalar(p, len);
+#endif
+}
+
+/**
+ * Find the first occurrence of one of two bytes.
+ * @param p bytes
+ * @param len number of bytes
+ * @param a first byte to find
+ * @param b second byte to find
+ * @return position of first match or len if there is none
+ */
+int kern_find(unsigned char *p, int len, unsigned char a, unsigned char b)
+{
+#ifdef KERN_AVX2
+   if (kern_avx2())
+      return kern_find_avx2(p, len, a, b);
+#endif
+#ifdef KERN_SSE2
+   return kern_find_sse2(p, len, a, b);
+#else
+   return kern_find_scalar(p, len, a, b);
+#endif
+}
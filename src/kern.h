@@ -0,0 +1,36 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file kern.h String kernels header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _KERN_H
+#define _KERN_H
+
+int kern_skip_nuls(unsigned char *p, int len, unsigned int *n);
+void kern_blank(unsigned char *p, int len);
+int kern_find(unsigned char *p, int len, unsigned char a, unsigned char b);
+
+#endif				/* _KERN_H */
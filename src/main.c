@@ -32,15 +32,29 @@
 #include <bsm/audit_record.h>
 
 #include <fcntl.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include <zlib.h>
 
 #include "main.h"
 #include "misc.h"
 #include "rand.h"
+#include "bsm.h"
 #include "pseu.h"
+#include "para.h"
+#include "filter.h"
+#include "emit.h"
+#include "cmap.h"
+#include "cols.h"
+#include "idx.h"
+#include "merge.h"
+#include "part.h"
+#include "rot.h"
+#include "dir.h"
 #include "config.h"
 
 /*
@@ -50,11 +64,47 @@ int zlib = 0, verbose = 0, blank_exec = 0, read_stdin = 0;
 int pseudonymize_pids = 1, pseudonymize_uids = 1, pseudonymize_gids = 1;
 int pseudonymize_time = 1, pseudonymize_paths = 1, pseudonymize_addrs = 1;
 int pseudonymize_args = 1;
+unsigned long path_memory = 0;
+int retire_pids = 0;
+int prefix_addrs = 0;
+int resync = 0;
+int output_format = EMIT_BSM;
+char *columns_dir = NULL;
+char *index_file = NULL;
+char *partition_spec = NULL;
+char *output_template = NULL;
+static char *rotate_limit = NULL;
+uint64_t time_from = 0, time_to = ~(uint64_t) 0;
+static int merge_inputs = 0;
+long estimate = -1;
 
 static uid_t uid_min = D_UID_MIN, uid_max = D_UID_MAX;
 static gid_t gid_min = D_GID_MIN, gid_max = D_GID_MAX;
 static pid_t pid_min = D_PID_MIN, pid_max = D_PID_MAX;
 static long time_shift = D_SHIFT_MAX;
+static int threads = 1;
+static unsigned long long seed;
+static int seeded = 0;
+
+static struct option long_options[] = {
+   {"seed", required_argument, NULL, 'k'},
+   {"event", required_argument, NULL, 't'},
+   {"class", required_argument, NULL, 'c'},
+   {"user", required_argument, NULL, 'w'},
+   {"drop", required_argument, NULL, 'X'},
+   {"format", required_argument, NULL, 'f'},
+   {"columns", required_argument, NULL, 'C'},
+   {"index", required_argument, NULL, 'I'},
+   {"from", required_argument, NULL, 'F'},
+   {"to", required_argument, NULL, 'T'},
+   {"merge", no_argument, NULL, 'M'},
+   {"partition", required_argument, NULL, 'o'},
+   {"output", required_argument, NULL, 'O'},
+   {"rotate", required_argument, NULL, 'L'},
+   {"help", no_argument, NULL, 'h'},
+   {"version", no_argument, NULL, 'V'},
+   {NULL, 0, NULL, 0}
+};
 static char **path_patterns = default_prefixes;
 
 extern char *optarg;
@@ -77,7 +127,7 @@ void print_version()
 void print_usage()
 {
    int i;
-   fprintf(stderr, "Usage: bsmpseu [options] [audit-trail-file...]\n"
+   fprintf(stderr, "Usage: bsmpseu [options] [audit-trail-file|dir...]\n"
 	   "Options:\n"
 	   "  -d list     Pseudonymize pathnames that match one of the prefixes from the\n"
 	   "              colon-separated list. Trailing slashes are not appended.\n"
@@ -88,6 +138,8 @@ void print_usage()
 
    fprintf(stderr,
            "  -D          Don't pseudonymize pathnames.\n"
+	   "  -m kbytes   Limit the memory used for the mapping of pathnames to\n"
+	   "              kbytes. Cold mappings are spilled to a temporary file.\n"
 	   "  -u min:max  Pseudonymize user IDs within the interval from min to max. \n"
 	   "              [Default: %d:%d uid]\n"
 	   "  -U          Don't pseudonymize user IDs.\n"
@@ -97,11 +149,70 @@ void print_usage()
 	   "  -p min:max  Pseudonymize process IDs within the interval from min to max.\n"
 	   "              [Default: %d:%d pid]\n"
 	   "  -P          Don't pseudonymize process IDs.\n"
+	   "  -r          Retire the pseudonym of a process ID when the process exits,\n"
+	   "              so that recycled process IDs get fresh pseudonyms.\n"
 	   "  -s shift    Pseudonymize timestamps of audit records by shifting upto a\n"
 	   "              maximum of seconds. [Default: %d seconds]\n"
 	   "  -S          Don't pseudonymize timestamps of audit records.\n"
 	   "  -A          Don't pseudonymize internet IPv4/IPv6 addresses.\n"
+	   "  -a          Pseudonymize internet addresses preserving their prefixes,\n"
+	   "              so that addresses of a subnet stay in a common subnet.\n"
+	   "  -e mbytes   Estimate the number of distinct IDs, addresses and pathnames\n"
+	   "              in a pre-scan over the first mbytes of each input (0 = all)\n"
+	   "              and size the mapping tables accordingly.\n"
 	   "  -E          Don't pseudonymize exec arguments and exec environment tokens.\n"
+	   "  -R          Skip corrupt data up to the next valid record instead of\n"
+	   "              stopping. The exit status indicates skipped data.\n"
+	   "  -k, --seed seed\n"
+	   "              Seed the generator of pseudonyms. Runs with the same seed\n"
+	   "              and options map the same input to the same output.\n"
+	   "              [Default: current time]\n"
+	   "  -t, --event list\n"
+	   "              Keep only records of the events from the comma-separated\n"
+	   "              list of event names or numbers.\n"
+	   "  -c, --class list\n"
+	   "              Keep only records of events in one of the audit classes\n"
+	   "              from the comma-separated list, e.g. lo,ex,fw.\n"
+	   "  -w, --user list\n"
+	   "              Keep only records whose subject has one of the audit user\n"
+	   "              IDs from the comma-separated list of users or uids.\n"
+	   "  -X, --drop list\n"
+	   "              Drop the token types from the comma-separated list, e.g.\n"
+	   "              exec_env,text, and patch the byte counts of the records.\n"
+	   "  -F, --from time\n"
+	   "              Keep only records at or after the time, given in seconds\n"
+	   "              since the epoch or as YYYY-MM-DD[THH:MM:SS] local time.\n"
+	   "              Trail files are searched for the first record, using an\n"
+	   "              index cached in file.zidx for compressed ones.\n"
+	   "  -T, --to time\n"
+	   "              Stop reading a trail at the first record after the time.\n"
+	   "  -M, --merge Merge the input files into one stream ordered by the\n"
+	   "              times of the records instead of concatenating them.\n"
+	   "  -j threads  Pseudonymize the input files in parallel using two passes.\n"
+	   "              The first pass collects all IDs, addresses and pathnames,\n"
+	   "              the second pass rewrites the files. [Default: 1 thread]\n"
+	   "  -f, --format format\n"
+	   "              Write the pseudonymized records as binary audit trail (bsm),\n"
+	   "              as praudit(1M)-style text lines (text) or as one JSON\n"
+	   "              object per record (json). [Default: bsm]\n"
+	   "  -C, --columns dir\n"
+	   "              Write the records as rows of typed column files to the\n"
+	   "              directory instead of the standard output.\n"
+	   "  -o, --partition key:n:prefix\n"
+	   "              Write the records to the n files prefix.0 to prefix.n-1,\n"
+	   "              partitioned by audit user ID (user) or by audit class\n"
+	   "              (class) instead of the standard output.\n"
+	   "  -O, --output template\n"
+	   "              Write the records to files named by the strftime(3)\n"
+	   "              template, using the time of their first record. %%N is\n"
+	   "              replaced by the sequence number of a file.\n"
+	   "  -L, --rotate limit\n"
+	   "              Start the next output file after a size (e.g. 512M) or\n"
+	   "              at the next period of record time (e.g. 1h or 1d).\n"
+	   "  -I, --index file\n"
+	   "              Write an index of the output to the file that maps record\n"
+	   "              times and numbers to offsets. With -z, each indexed block\n"
+	   "              is a gzip member that can be decompressed on its own.\n"
 	   "  -z          Compress output stream using the zlib(3).\n"
 	   "  -v          Display verbose information during pseudonymizing to stderr.\n"
 	   "  -V          Display version information.\n", D_UID_MIN,
@@ -109,6 +220,41 @@ void print_usage()
 	   D_SHIFT_MAX);
 }
 
+/**
+ * Parse a point in time. Either seconds since the epoch or a local date
+ * of the form YYYY-MM-DD, optionally followed by a time HH:MM:SS
+ * separated by a blank or a T, is accepted.
+ * @param str string to parse
+ * @param t receives the time in seconds since the epoch
+ * @return 1 on success or 0 on failure
+ */
+static int parse_time(char *str, uint64_t * t)
+{
+   struct tm tm;
+   time_t sec;
+   char *end;
+   int n;
+
+   *t = strtoull(str, &end, 10);
+   if (*str && !*end)
+      return 1;
+
+   memset(&tm, 0, sizeof(tm));
+   n = sscanf(str, "%d-%d-%d%*[ T]%d:%d:%d", &tm.tm_year, &tm.tm_mon,
+	      &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+   if (n != 3 && n != 6)
+      return 0;
+
+   tm.tm_year -= 1900;
+   tm.tm_mon -= 1;
+   tm.tm_isdst = -1;
+   if ((sec = mktime(&tm)) == -1)
+      return 0;
+
+   *t = sec;
+   return 1;
+}
+
 /**
  * Parse options from the commandline.
  * @param argc Number of arguments
@@ -122,7 +268,8 @@ void parse_options(int argc, char **argv)
    /*
     * Parse commandline options.
     */
-   while ((c = getopt(argc, argv, "Dd:Uu:Gg:Pp:s:AEhvzV")) != EOF)
+   while ((c = getopt_long(argc, argv, "Dd:m:Uu:Gg:Pp:rs:Aae:ERj:k:t:c:w:X:f:C:I:F:T:Mo:O:L:hvzV",
+			   long_options, NULL)) != EOF)
       switch (c) {
       case 'd':
 	 c = 0;
@@ -143,6 +290,9 @@ void parse_options(int argc, char **argv)
       case 'D':
          pseudonymize_paths = 0;
          break;
+      case 'm':
+	 path_memory = strtoul(optarg, NULL, 10) * 1024;
+	 break;
       case 'p':
 	 pid_min = atol(optarg);
 	 str = strrchr(optarg, ':');
@@ -153,6 +303,9 @@ void parse_options(int argc, char **argv)
       case 'P':
          pseudonymize_pids = 0;	 
          break;
+      case 'r':
+	 retire_pids = 1;
+	 break;
       case 'g':
 	 gid_min = atol(optarg);
 	 str = strrchr(optarg, ':');
@@ -182,9 +335,78 @@ void parse_options(int argc, char **argv)
       case 'A':
 	 pseudonymize_addrs = 0;
 	 break;
+      case 'a':
+	 prefix_addrs = 1;
+	 break;
+      case 'e':
+	 estimate = atol(optarg) * 1024 * 1024;
+	 if (estimate < 0)
+	    goto err;
+	 break;
       case 'E':
 	 pseudonymize_args = 0;
 	 break;
+      case 'R':
+	 resync = 1;
+	 break;
+      case 'j':
+	 threads = atoi(optarg);
+	 if (threads < 1 || threads > PARA_MAX_THREADS)
+	    goto err;
+	 break;
+      case 'k':
+	 seed = strtoull(optarg, &str, 0);
+	 if (*str)
+	    goto err;
+	 seeded = 1;
+	 break;
+      case 't':
+	 if (!filter_events(optarg))
+	    exit(EXIT_FAILURE);
+	 break;
+      case 'c':
+	 if (!filter_classes(optarg))
+	    exit(EXIT_FAILURE);
+	 break;
+      case 'w':
+	 if (!filter_uids(optarg))
+	    exit(EXIT_FAILURE);
+	 break;
+      case 'X':
+	 if (!pseu_drop(optarg))
+	    exit(EXIT_FAILURE);
+	 break;
+      case 'f':
+	 output_format = emit_format(optarg);
+	 if (output_format < 0)
+	    goto err;
+	 break;
+      case 'C':
+	 columns_dir = optarg;
+	 break;
+      case 'I':
+	 index_file = optarg;
+	 break;
+      case 'F':
+	 if (!parse_time(optarg, &time_from))
+	    goto err;
+	 break;
+      case 'T':
+	 if (!parse_time(optarg, &time_to))
+	    goto err;
+	 break;
+      case 'M':
+	 merge_inputs = 1;
+	 break;
+      case 'o':
+	 partition_spec = optarg;
+	 break;
+      case 'O':
+	 output_template = optarg;
+	 break;
+      case 'L':
+	 rotate_limit = optarg;
+	 break;
       case 'v':
 	 verbose = 1;
 	 break;
@@ -214,8 +436,101 @@ void parse_options(int argc, char **argv)
    if (pid_min >= pid_max)
       pseudonymize_pids = 0;
 
+   if (!pseudonymize_pids)
+      retire_pids = 0;
+
+   if (!pseudonymize_addrs)
+      prefix_addrs = 0;
+
+   if (!seeded)
+      seed = time(NULL);
+
    if (time_shift <= 0)
       pseudonymize_time = 0;
+
+   /*
+    * Standard input can't be read twice, so it is processed sequentially.
+    */
+   if (optind == argc)
+      threads = 1;
+
+   /*
+    * The parallel mode relies on a complete mapping that is only read by
+    * the threads. Eviction and retirement would modify it.
+    */
+   if (threads > 1 && path_memory) {
+      err_msg("Path memory limit not supported with -j, ignored");
+      path_memory = 0;
+   }
+
+   if (threads > 1 && retire_pids) {
+      err_msg("Retirement of pids not supported with -j, ignored");
+      retire_pids = 0;
+   }
+
+   /*
+    * The columns are written by a single writer.
+    */
+   if (threads > 1 && columns_dir) {
+      err_msg("Columnar output not supported with -j, using 1 thread");
+      threads = 1;
+   }
+
+   if (partition_spec && (output_format != EMIT_BSM || columns_dir)) {
+      err_msg("Partitioning requires binary output, ignored");
+      partition_spec = NULL;
+   }
+
+   if (rotate_limit && !output_template) {
+      err_msg("Rotation requires output files, ignored");
+      rotate_limit = NULL;
+   }
+
+   if (output_template && (output_format != EMIT_BSM || columns_dir)) {
+      err_msg("Output files require binary output, ignored");
+      output_template = NULL;
+   }
+
+   if (output_template && partition_spec) {
+      err_msg("Output files not supported with partitioning, ignored");
+      output_template = NULL;
+   }
+
+   if (partition_spec && index_file) {
+      err_msg("Index not supported with partitioning, ignored");
+      index_file = NULL;
+   }
+
+   /*
+    * Offsets are only meaningful for binary audit trails.
+    */
+   if (index_file && (output_format != EMIT_BSM || columns_dir)) {
+      err_msg("Index requires binary output, ignored");
+      index_file = NULL;
+   }
+
+   if (threads > 1 && index_file) {
+      err_msg("Index not supported with -j, using 1 thread");
+      threads = 1;
+   }
+
+   if (threads > 1 && partition_spec) {
+      err_msg("Partitioning not supported with -j, using 1 thread");
+      threads = 1;
+   }
+
+   if (threads > 1 && output_template) {
+      err_msg("Output files not supported with -j, using 1 thread");
+      threads = 1;
+   }
+
+   if (threads > 1 && merge_inputs) {
+      err_msg("Merge not supported with -j, using 1 thread");
+      threads = 1;
+   }
+
+   if (threads > 1)
+      estimate = -1;
 }
 
 void print_config()
@@ -229,8 +544,12 @@ void print_config()
       fprintf(stderr, "%s:", path_patterns[i]);
    fprintf(stderr, "\b]\n");
 
+   if (path_memory)
+      fprintf(stderr, "   Path memory:    %lu kbytes\n", path_memory / 1024);
+
    fprintf(stderr, "   Process IDs:    %s", pseudonymize_pids ? "Yes" : "No ");
-   fprintf(stderr, " [%ld:%ld pid]\n", pid_min, pid_max);
+   fprintf(stderr, " [%ld:%ld pid]%s\n", pid_min, pid_max,
+	   retire_pids ? " retired on exit" : "");
 
    fprintf(stderr, "   User IDs:       %s", pseudonymize_uids ? "Yes" : "No ");
    fprintf(stderr, " [%ld:%ld uid]\n", uid_min, uid_max);
@@ -241,77 +560,226 @@ void print_config()
    fprintf(stderr, "   Timestamps:     %s", pseudonymize_time ? "Yes" : "No ");
    fprintf(stderr, " [%ld seconds]\n", time_shift);
 
-   fprintf(stderr, "   Inet addresses: %s\n",
-	   pseudonymize_addrs ? "Yes" : "No ");
+   fprintf(stderr, "   Inet addresses: %s%s\n",
+	   pseudonymize_addrs ? "Yes" : "No ",
+	   prefix_addrs ? " [prefix-preserving]" : "");
    fprintf(stderr, "   Exec args/anv:  %s\n",
 	   pseudonymize_args ? "Yes" : "No ");
+   if (estimate >= 0)
+      fprintf(stderr, "   Pre-scan:       %ld mbytes\n",
+	      estimate / 1024 / 1024);
+   if (threads > 1)
+      fprintf(stderr, "   Threads:        %d\n", threads);
+   fprintf(stderr, "   Seed:           %llu\n", seed);
    fprintf(stderr, "\n");
 }
 
 /**
- * Another boring main function
- * @param argc the usual count
- * @param argv probably some overflowing strings
- * @return if we are lucky
+ * Pre-scan the input files and size the mapping tables according to the
+ * estimated number of distinct fields. If the scan stops early, the
+ * estimates are extrapolated to the size of the input. Standard input
+ * can't be scanned twice and is therefore not supported.
+ * @param argc Number of arguments
+ * @param argv Array of arguments
  */
-int main(int argc, char **argv)
+void presize(int argc, char **argv)
 {
-   int ret;
-   gzFile *in, *zout;
-   FILE *out;
+   bsm_stream_t *in;
+   long long size, total = 0;
+   long bytes, scanned = 0;
+   double scale = 1.0;
+   int i;
 
-   parse_options(argc, argv);
-   if (verbose)
-      print_config();
+   if (optind == argc) {
+      err_msg("Pre-scan not possible on standard input");
+      return;
+   }
 
-   srand48(time(NULL));
-   ret = pseu_init(uid_min, uid_max, gid_min, gid_max, pid_min,
-		   pid_max, path_patterns, time_shift);
-   if (!ret) {
+   for (i = optind; i < argc; i++) {
+      in = bsm_open(argv[i]);
+      if (!in) {
+	 err_msg("Could not open %s", argv[i]);
+	 exit(EXIT_FAILURE);
+      }
+      in->quiet = 1;
+
+      if (bsm_check(in)) {
+	 bytes = pseu_estimate(in, estimate);
+	 scanned += bytes;
+	 if (verbose)
+	    fprintf(stderr, "[estimate] %s: %ld bytes scanned\n", argv[i],
+		    bytes);
+      }
+
+      /*
+       * The size of a compressed file may depend on the data scanned.
+       */
+      size = bsm_size(in);
+      if (size < 0 || total < 0)
+	 total = -1;
+      else
+	 total += size;
+      bsm_close(in);
+   }
+
+   if (scanned > 0 && total > scanned)
+      scale = (double) total / scanned;
+   if (verbose && scale > 1.0)
+      fprintf(stderr, "[estimate] extrapolated to %lld bytes\n", total);
+
+   if (!pseu_presize(scale)) {
       err_msg("Failed to allocate memory");
       exit(EXIT_FAILURE);
    }
+}
 
-   if (optind == argc) {
+/**
+ * Pseudonymize the input files one after another and write the result to
+ * the standard output. Without input files the standard input is read.
+ * @param argc Number of arguments
+ * @param argv Array of arguments
+ * @return 1 on success or 0 if an input has been truncated or corrupt data
+ * has been skipped
+ */
+int process(int argc, char **argv)
+{
+   bsm_stream_t *in;
+   bsm_out_t out;
+   dir_prefetch_t *prefetch;
+   int ret = 1, first;
+
+   if (optind == argc)
       read_stdin = 1;
-      in = gzdopen(0, "rb");
+
+   /*
+    * Output files and partitions are opened later, the standard output
+    * is not used then.
+    */
+   if (!bsm_out_open(&out, output_template || partition_spec ? -1 : 1, zlib,
+		     output_format)) {
+      err_msg("Could not open standard output");
+      exit(EXIT_FAILURE);
    }
 
-   if (zlib) {
-      zout = gzdopen(1, "wb9");
-      out = NULL;
-   } else {
-      zout = NULL;
-      out = fdopen(1, "wb");
+   if (columns_dir && !(out.cols = cols_open(columns_dir)))
+      exit(EXIT_FAILURE);
+
+   /*
+    * With output files, the index file is a template for the index of
+    * each file.
+    */
+   if (output_template && !(out.rot = rot_open(output_template, index_file,
+					       rotate_limit, zlib)))
+      exit(EXIT_FAILURE);
+
+   if (index_file && !out.rot && !(out.idx = idx_open(&out, index_file)))
+      exit(EXIT_FAILURE);
+
+   if (partition_spec && !(out.part = part_open(partition_spec, zlib)))
+      exit(EXIT_FAILURE);
+
+   if (merge_inputs && argc - optind > 1) {
+      ret = merge_run(argv + optind, argc - optind, &out);
+      optind = argc;
    }
 
+   first = optind;
+   prefetch = dir_prefetch_start(argv + optind, argc - optind);
+
    for (; read_stdin || optind < argc; optind++) {
+      dir_prefetch(prefetch, optind - first);
 
-      if (!read_stdin)
-	 in = gzopen(argv[optind], "rb");
+      if (read_stdin)
+	 in = bsm_dopen(0, "stdin");
+      else
+	 in = bsm_open(argv[optind]);
 
       if (!in) {
-	 err_msg("Could not open %s", argv[optind] ? argv[optind] : "stdin");
+	 err_msg("Could not open %s", read_stdin ? "stdin" : argv[optind]);
 	 exit(EXIT_FAILURE);
       }
 
-      if(!bsm_check(in, !read_stdin ? argv[optind] : "stdin"))
-         continue;
+      if (bsm_check(in)) {
+	 /*
+	  * Reading and decompressing overlap with the processing of the
+	  * file. Without a read-ahead the file is read synchronously.
+	  */
+	 bsm_ahead(in);
+
+	 while (!bsm_eof(in))
+	    if (!pseu_token(in, &out)) {
+	       err_msg("Stopped processing %s at %ld", in->name, in->o_pos);
+	       ret = 0;
+	       break;
+	    }
+      }
 
-      bsm_reset(in);
-      while (!bsm_eof(in))
-	 pseu_token(in, zout, out);
+      if (in->skipped)
+	 ret = 0;
 
-      if(read_stdin)
-         break;
+      bsm_close(in);
+      if (read_stdin)
+	 break;
+   }
+   dir_prefetch_stop(prefetch);
+
+   if (!bsm_out_close(&out))
+      ret = 0;
+
+   return ret;
+}
+
+/**
+ * Another boring main function
+ * @param argc the usual count
+ * @param argv probably some overflowing strings
+ * @return if we are lucky
+ */
+int main(int argc, char **argv)
+{
+   int ret, i;
+
+   parse_options(argc, argv);
+
+   /*
+    * Audit directories are replaced by their trail files.
+    */
+   if (optind < argc) {
+      if (!dir_expand(&argc, &argv, optind))
+	 exit(EXIT_FAILURE);
+      if (optind == argc) {
+	 err_msg("No audit trail files to process");
+	 exit(EXIT_FAILURE);
+      }
    }
 
+   if (verbose)
+      print_config();
+
+   ret = pseu_init(uid_min, uid_max, gid_min, gid_max, pid_min,
+		   pid_max, path_patterns, time_shift, seed);
+   if (!ret) {
+      err_msg("Failed to allocate memory");
+      exit(EXIT_FAILURE);
+   }
+
+   if (estimate >= 0)
+      presize(argc, argv);
+
+   if (threads > 1)
+      ret = para_run(argv + optind, argc - optind, threads);
+   else
+      ret = process(argc, argv);
+
    pseu_deinit();
+   filter_deinit();
 
-   for (ret = 0; path_patterns[ret]; ret++)
-      free(path_patterns[ret]);
+   if (path_patterns != default_prefixes) {
+      for (i = 0; path_patterns[i]; i++)
+	 free(path_patterns[i]);
 
-   free(path_patterns);
+      free(path_patterns);
+   }
 
-   return EXIT_SUCCESS;
+   return ret ? EXIT_SUCCESS : EXIT_FAILURE;
 }
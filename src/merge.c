@@ -0,0 +1,200 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file merge.c Time-ordered merge of audit trails.
+ * The trails of several hosts are merged into one stream ordered by the
+ * times of the records, as auditreduce(1M) does. All inputs are read at
+ * once, each by a read-ahead thread of its own, and the input with the
+ * earliest next record is kept at the top of a heap. Whole records are
+ * pseudonymized and written in turn using the common mapping. Tokens
+ * outside of records, e.g. file tokens, are written along with the
+ * record before them or, at the start of a trail, first.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "bsm.h"
+#include "pseu.h"
+#include "merge.h"
+#include "config.h"
+
+/**
+ * Compare two inputs of a merge.
+ * @param a first input
+ * @param b second input
+ * @return 1 if a comes before b or 0 otherwise
+ */
+static int merge_before(merge_src_t * a, merge_src_t * b)
+{
+   if (a->time != b->time)
+      return a->time < b->time;
+
+   return a->order < b->order;
+}
+
+/**
+ * Move an input down the heap to its place.
+ * @param heap heap of inputs
+ * @param n number of inputs
+ * @param i position of input
+ */
+static void merge_down(merge_src_t * heap, int n, int i)
+{
+   merge_src_t tmp;
+   int c;
+
+   while ((c = 2 * i + 1) < n) {
+      if (c + 1 < n && merge_before(&heap[c + 1], &heap[c]))
+	 c++;
+      if (!merge_before(&heap[c], &heap[i]))
+	 break;
+
+      tmp = heap[i];
+      heap[i] = heap[c];
+      heap[c] = tmp;
+      i = c;
+   }
+}
+
+/**
+ * Determine the key of an input from its next token. Tokens before the
+ * first record are written first.
+ * @param src input
+ * @return 1 on success or 0 if the input is exhausted
+ */
+static int merge_key(merge_src_t * src)
+{
+   switch (bsm_peek(src->in, &src->time)) {
+   case 0:
+      src->time = 0;
+      return 1;
+   case 1:
+      return 1;
+   default:
+      return 0;
+   }
+}
+
+/**
+ * Close an exhausted input of a merge.
+ * @param src input
+ * @return 1 if the input has been read completely or 0 if it has been
+ * truncated or corrupt data has been skipped
+ */
+static int merge_close(merge_src_t * src)
+{
+   int ret = 1;
+
+   if (!bsm_eof(src->in)) {
+      err_msg("Stopped processing %s at %ld", src->in->name,
+	      src->in->o_pos);
+      ret = 0;
+   }
+
+   if (src->in->skipped)
+      ret = 0;
+
+   bsm_close(src->in);
+   return ret;
+}
+
+/**
+ * Merge audit trails by the times of their records and write the
+ * pseudonymized records to an output stream.
+ * @param names names of input files
+ * @param n number of input files
+ * @param out output stream
+ * @return 1 on success or 0 if an input has been truncated or corrupt data
+ * has been skipped
+ */
+int merge_run(char **names, int n, bsm_out_t * out)
+{
+   merge_src_t *heap, *top;
+   int i, ok, num = 0, ret = 1;
+
+   if (!(heap = malloc(sizeof(merge_src_t) * n))) {
+      err_msg("Failed to allocate memory");
+      return 0;
+   }
+
+   for (i = 0; i < n; i++) {
+      heap[num].in = bsm_open(names[i]);
+      heap[num].order = i;
+
+      if (!heap[num].in) {
+	 err_msg("Could not open %s", names[i]);
+	 exit(EXIT_FAILURE);
+      }
+
+      if (!bsm_check(heap[num].in)) {
+	 bsm_close(heap[num].in);
+	 continue;
+      }
+
+      /*
+       * Without a read-ahead the input is read synchronously.
+       */
+      bsm_ahead(heap[num].in);
+
+      if (merge_key(&heap[num]))
+	 num++;
+      else if (!merge_close(&heap[num]))
+	 ret = 0;
+   }
+
+   for (i = num / 2 - 1; i >= 0; i--)
+      merge_down(heap, num, i);
+
+   /*
+    * The input at the top writes one record and the tokens following it,
+    * up to its next header.
+    */
+   while (num > 0) {
+      top = &heap[0];
+
+      do {
+	 if (!(ok = pseu_token(top->in, out)))
+	    break;
+      } while (!bsm_peek(top->in, &top->time));
+
+      if (!ok || !merge_key(top)) {
+	 if (!merge_close(top))
+	    ret = 0;
+	 heap[0] = heap[--num];
+      }
+
+      merge_down(heap, num, 0);
+   }
+
+   free(heap);
+   return ret;
+}
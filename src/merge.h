@@ -0,0 +1,44 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file merge.h Time-ordered merge of audit trails header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _MERGE_H
+#define _MERGE_H
+
+/**
+ * Input of a merge. Inputs are kept in a heap ordered by the time of
+ * their next record and by their position on the command line.
+ */
+typedef struct {
+   bsm_stream_t *in;		     /**< Input stream */
+   uint64_t time;		     /**< Time of next record */
+   int order;			     /**< Position of input */
+} merge_src_t;
+
+int merge_run(char **names, int n, bsm_out_t * out);
+
+#endif				/* _MERGE_H */
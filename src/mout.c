@@ -0,0 +1,247 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file mout.c Memory-mapped output.
+ * Uncompressed output to a regular file can be copied into a window of
+ * the file mapped into memory instead of passing through the small
+ * buffer of stdio. The file is preallocated in extents ahead of the
+ * window, so that the storage sees large sequential allocations and
+ * a full file system is reported when an extent is allocated instead of
+ * raising SIGBUS on a write to the window. A full window is scheduled for
+ * writing and the next window is mapped. When the file is closed, it is
+ * truncated to the length of the written data.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "mout.h"
+#include "config.h"
+
+/**
+ * Preallocate a file up to the given size. Without posix_fallocate(3C)
+ * the file is only extended.
+ * @param fd file descriptor
+ * @param alloc size already allocated
+ * @param size size of file
+ * @return 1 on success or 0 on failure
+ */
+int mout_reserve(int fd, long long alloc, long long size)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+   if ((errno = posix_fallocate(fd, alloc, size - alloc))) {
+      err_msg("Could not allocate output file");
+      return 0;
+   }
+#else
+   if (ftruncate(fd, size)) {
+      err_msg("Could not allocate output file");
+      return 0;
+   }
+#endif
+
+   return 1;
+}
+
+/**
+ * Preallocate the file up to the extent covering the given size. The first
+ * extent is one window, each further extent doubles the file up to
+ * MOUT_EXTENT, so that small files don't reserve large extents.
+ * @param m mapped output
+ * @param size size of file needed
+ * @return 1 on success or 0 on failure
+ */
+static int mout_extend(mout_t * m, long long size)
+{
+   long long n = m->alloc;
+
+   while (n < size)
+      n += n < MOUT_WINDOW ? MOUT_WINDOW : n < MOUT_EXTENT ? n : MOUT_EXTENT;
+   if (!mout_reserve(m->fd, m->alloc, n))
+      return 0;
+
+   m->alloc = n;
+   return 1;
+}
+
+/**
+ * Map the window at the current base of a mapped output.
+ * @param m mapped output
+ * @return 1 on success or 0 on failure
+ */
+static int mout_map(mout_t * m)
+{
+   char *win;
+
+   if (m->base + MOUT_WINDOW > m->alloc &&
+       !mout_extend(m, m->base + MOUT_WINDOW))
+      return 0;
+
+   win = mmap(NULL, MOUT_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd,
+	      m->base);
+   if (win == MAP_FAILED) {
+      err_msg("mmap");
+      return 0;
+   }
+
+#ifdef HAVE_MADVISE
+   madvise(win, MOUT_WINDOW, MADV_SEQUENTIAL);
+#endif
+
+   m->win = win;
+   return 1;
+}
+
+/**
+ * Unmap the window of a mapped output. The dirty pages of the window are
+ * scheduled for writing first.
+ * @param m mapped output
+ */
+static void mout_unmap(mout_t * m)
+{
+   if (!m->win)
+      return;
+
+   msync(m->win, MOUT_WINDOW, MS_ASYNC);
+   munmap(m->win, MOUT_WINDOW);
+   m->win = NULL;
+}
+
+/**
+ * Open a mapped output on a file descriptor. Writing starts at the current
+ * position of the descriptor, which has to be open for reading and
+ * writing.
+ * @param fd file descriptor
+ * @return mapped output or NULL if the file is not a regular file or
+ * can't be mapped, in which case stdio is used
+ */
+mout_t *mout_open(int fd)
+{
+   struct stat st;
+   long long pos;
+   mout_t *m;
+
+   /*
+    * Shared mappings need a descriptor open for reading and writing.
+    */
+   if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+       (fcntl(fd, F_GETFL) & O_ACCMODE) != O_RDWR ||
+       (pos = lseek(fd, 0, SEEK_CUR)) < 0)
+      return NULL;
+
+   if (!(m = malloc(sizeof(mout_t))))
+      return NULL;
+
+   /*
+    * Windows start at multiples of the window size, which are aligned to
+    * pages.
+    */
+   m->fd = fd;
+   m->win = NULL;
+   m->base = pos / MOUT_WINDOW * MOUT_WINDOW;
+   m->win_pos = pos - m->base;
+   m->alloc = st.st_size;
+
+   /*
+    * Stdio takes over, thus a partial preallocation is undone.
+    */
+   if (!mout_map(m)) {
+      if (m->alloc > st.st_size && ftruncate(fd, st.st_size))
+	 err_msg("ftruncate");
+      free(m);
+      return NULL;
+   }
+
+   return m;
+}
+
+/**
+ * Write data to a mapped output.
+ * @param m mapped output
+ * @param buf data
+ * @param len length of data
+ * @return 1 on success or 0 on failure
+ */
+int mout_write(mout_t * m, char *buf, int len)
+{
+   long n;
+
+   while (len > 0) {
+      if (m->win_pos == MOUT_WINDOW) {
+	 mout_unmap(m);
+	 m->base += MOUT_WINDOW;
+	 m->win_pos = 0;
+      }
+
+      if (!m->win && !mout_map(m))
+	 return 0;
+
+      n = MOUT_WINDOW - m->win_pos;
+      if (n > len)
+	 n = len;
+
+      memcpy(m->win + m->win_pos, buf, n);
+      m->win_pos += n;
+      buf += n;
+      len -= n;
+   }
+
+   return 1;
+}
+
+/**
+ * Close a mapped output. The file is truncated to the written data and
+ * its descriptor is closed.
+ * @param m mapped output
+ * @return 1 on success or 0 on failure
+ */
+int mout_close(mout_t * m)
+{
+   int ret = 1;
+
+   mout_unmap(m);
+
+   if (ftruncate(m->fd, m->base + m->win_pos)) {
+      err_msg("ftruncate");
+      ret = 0;
+   }
+
+   if (close(m->fd)) {
+      err_msg("close");
+      ret = 0;
+   }
+
+   free(m);
+   return ret;
+}
@@ -0,0 +1,54 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file mout.h Memory-mapped output header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _MOUT_H
+#define _MOUT_H
+
+#define MOUT_WINDOW       (8 << 20)	/**< Size of a mapped window */
+#define MOUT_EXTENT       (64 << 20)	/**< Maximum size of an extent */
+
+/**
+ * Memory-mapped output file. Data is copied into a window of the file
+ * that is mapped into memory. The file is preallocated in growing extents
+ * ahead of the window and truncated to the written length when it is
+ * closed.
+ */
+typedef struct s_mout {
+   int fd;			     /**< File descriptor of file */
+   char *win;			     /**< Mapped window or NULL */
+   long long base;		     /**< Offset of window in file */
+   long win_pos;		     /**< Write position in window */
+   long long alloc;		     /**< Preallocated size of file */
+} mout_t;
+
+mout_t *mout_open(int fd);
+int mout_reserve(int fd, long long alloc, long long size);
+int mout_write(mout_t * m, char *buf, int len);
+int mout_close(mout_t * m);
+
+#endif				/* _MOUT_H */
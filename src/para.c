@@ -0,0 +1,442 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file para.c Parallel two-pass pseudonymization.
+ * The input files are processed in two passes. In the first pass each
+ * thread scans a share of the files and collects the distinct uids, gids,
+ * pids, addresses and pathnames in thread-local sets. The sets are merged
+ * and sorted, and all pseudonyms are assigned in one deterministic step.
+ * In the second pass the threads rewrite the files against the complete
+ * mapping, which is only read, into temporary files that are concatenated
+ * to the output in the order of the input files. Thus the output does not
+ * depend on the scheduling of the threads.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "hash.h"
+#include "bsm.h"
+#include "pseu.h"
+#include "para.h"
+#include "config.h"
+
+extern int verbose, zlib, output_format;
+
+static para_file_t *files;		/**< Input files */
+static int nfiles;			/**< Number of input files */
+static int next_file;			/**< Next file to be processed */
+
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Fetch the index of the next unprocessed input file.
+ * @return index of file or -1 if all files have been taken
+ */
+static int para_next()
+{
+   int i;
+
+   i = __atomic_fetch_add(&next_file, 1, __ATOMIC_RELAXED);
+   return i < nfiles ? i : -1;
+}
+
+/**
+ * Open an input file. The program exits if the file can't be opened.
+ * @param name name of file
+ * @return stream
+ */
+static bsm_stream_t *para_open(char *name)
+{
+   bsm_stream_t *in;
+
+   in = bsm_open(name);
+   if (!in) {
+      err_msg("Could not open %s", name);
+      exit(EXIT_FAILURE);
+   }
+
+   return in;
+}
+
+/**
+ * Add a field to the thread-local set of its type.
+ * @param type type of field
+ * @param key field
+ * @param len length of field
+ * @param arg sets of the thread
+ */
+static void para_collect(int type, uchar_t * key, ushort_t len, void *arg)
+{
+   hash_table_t **sets = arg;
+   para_key_t *k;
+
+   if (hash_get(sets[type], len, key))
+      return;
+
+   /*
+    * Fields missing in the sets are still mapped in the second pass, so
+    * running out of memory here is not fatal.
+    */
+   k = malloc(sizeof(para_key_t) + len);
+   if (!k) {
+      err_msg("Failed to allocate memory");
+      return;
+   }
+
+   k->len = len;
+   memcpy(k->key, key, len);
+   if (hash_insert(sets[type], k, len, key))
+      free(k);
+}
+
+/**
+ * Thread of the first pass. The thread scans input files and collects
+ * the fields to be mapped in its sets.
+ * @param arg sets of the thread
+ * @return NULL
+ */
+static void *para_scan(void *arg)
+{
+   uchar_t buf[BSM_TOKEN_MAX];
+   bsm_stream_t *in;
+   int i, len;
+
+   while ((i = para_next()) >= 0) {
+      in = para_open(files[i].name);
+      in->quiet = 1;
+
+      files[i].valid = bsm_check(in);
+      while (files[i].valid && !bsm_eof(in)) {
+	 len = BSM_TOKEN_MAX;
+	 if (!bsm_read(in, buf, &len))
+	    break;
+
+	 if (len && !(in->chunk & BSM_CHUNK_CONT))
+	    pseu_collect(buf, para_collect, arg);
+      }
+
+      bsm_close(in);
+   }
+
+   return NULL;
+}
+
+/**
+ * Compare two collected fields by length and content.
+ * @param a first field
+ * @param b second field
+ * @return result of comparison as required by qsort(3)
+ */
+static int para_cmp(const void *a, const void *b)
+{
+   para_key_t *x = *(para_key_t **) a, *y = *(para_key_t **) b;
+
+   if (x->len != y->len)
+      return x->len - y->len;
+
+   return memcmp(x->key, y->key, x->len);
+}
+
+/**
+ * Merge the sets of all threads into the sets of the first thread. The
+ * sets of the other threads are freed.
+ * @param sets sets of all threads
+ * @param threads number of threads
+ */
+static void para_merge(hash_table_t *(*sets)[FIELDS], int threads)
+{
+   hash_iterator_t it;
+   para_key_t *k;
+   int i, t;
+
+   for (t = 1; t < threads; t++) {
+      for (i = 0; i < FIELDS; i++) {
+	 for (k = hash_first(sets[t][i], &it); k;
+	      k = hash_next(sets[t][i], &it)) {
+	    if (hash_get(sets[0][i], k->len, k->key) ||
+		hash_insert(sets[0][i], k, k->len, k->key))
+	       free(k);
+	 }
+	 hash_finalize(sets[t][i]);
+      }
+   }
+}
+
+/**
+ * Assign the pseudonyms of all collected fields. The mapping tables are
+ * sized for the exact number of fields, then the fields of each type are
+ * sorted and mapped in this order. The sets are freed.
+ * @param sets merged sets
+ * @return 1 on success or 0 on failure
+ */
+static int para_assign(hash_table_t ** sets)
+{
+   unsigned long counts[FIELDS];
+   hash_iterator_t it;
+   para_key_t **keys;
+   unsigned int i, n;
+   int t;
+
+   for (t = 0; t < FIELDS; t++)
+      counts[t] = sets[t]->i_items;
+
+   if (!pseu_resize(counts))
+      return 0;
+
+   for (t = 0; t < FIELDS; t++) {
+      keys = malloc(sizeof(para_key_t *) * (counts[t] + 1));
+      if (!keys)
+	 return 0;
+
+      n = 0;
+      for (keys[n] = hash_first(sets[t], &it); keys[n];
+	   keys[n] = hash_next(sets[t], &it))
+	 n++;
+
+      qsort(keys, n, sizeof(para_key_t *), para_cmp);
+
+      for (i = 0; i < n; i++) {
+	 pseu_map(t, keys[i]->key, keys[i]->len);
+	 free(keys[i]);
+      }
+
+      free(keys);
+      hash_finalize(sets[t]);
+   }
+
+   return 1;
+}
+
+/**
+ * Pseudonymize an input file into a temporary file. If compression is
+ * enabled, the temporary file holds a complete gzip member, so that the
+ * temporary files can simply be concatenated.
+ * @param f input file, failures are recorded in it
+ * @return temporary file rewound to its beginning or NULL on failure
+ */
+static FILE *para_rewrite_file(para_file_t * f)
+{
+   bsm_stream_t *in;
+   bsm_out_t out;
+   char *name = f->name;
+   FILE *tmp;
+
+   tmp = tmpfile();
+   if (!tmp) {
+      err_msg("Could not create temporary file for %s", name);
+      return NULL;
+   }
+
+   if (!bsm_out_open(&out, dup(fileno(tmp)), zlib, output_format)) {
+      err_msg("Could not open temporary file for %s", name);
+      fclose(tmp);
+      return NULL;
+   }
+
+   in = para_open(name);
+   while (!bsm_eof(in))
+      if (!pseu_token(in, &out)) {
+	 err_msg("Stopped processing %s at %ld", name, in->o_pos);
+	 f->failed = 1;
+	 break;
+      }
+
+   if (in->skipped)
+      f->failed = 1;
+
+   bsm_close(in);
+   if (!bsm_out_close(&out))
+      f->failed = 1;
+
+   rewind(tmp);
+   return tmp;
+}
+
+/**
+ * Thread of the second pass. The thread pseudonymizes input files and
+ * signals each finished file.
+ * @param arg unused
+ * @return NULL
+ */
+static void *para_rewrite(void *arg)
+{
+   FILE *tmp;
+   int i;
+
+   while ((i = para_next()) >= 0) {
+      tmp = files[i].valid ? para_rewrite_file(&files[i]) : NULL;
+
+      pthread_mutex_lock(&done_lock);
+      files[i].tmp = tmp;
+      files[i].done = 1;
+      pthread_cond_broadcast(&done_cond);
+      pthread_mutex_unlock(&done_lock);
+   }
+
+   return NULL;
+}
+
+/**
+ * Run a pass with the given number of threads and wait for all threads.
+ * If fn_out is given, it is called for each input file in order as soon
+ * as the file is finished.
+ * @param fn thread function
+ * @param args arguments of the threads
+ * @param size size of an argument
+ * @param threads number of threads
+ * @param fn_out output function or NULL
+ * @return 1 on success or 0 on failure
+ */
+static int para_pass(void *(*fn) (void *), char *args, size_t size,
+		     int threads, int (*fn_out) (para_file_t *))
+{
+   pthread_t tids[PARA_MAX_THREADS];
+   int i, t, ret = 1;
+
+   next_file = 0;
+   for (t = 0; t < threads; t++) {
+      if (pthread_create(&tids[t], NULL, fn, args + t * size)) {
+	 err_msg("Could not create thread");
+	 exit(EXIT_FAILURE);
+      }
+   }
+
+   for (i = 0; fn_out && i < nfiles; i++) {
+      pthread_mutex_lock(&done_lock);
+      while (!files[i].done)
+	 pthread_cond_wait(&done_cond, &done_lock);
+      pthread_mutex_unlock(&done_lock);
+
+      if (!fn_out(&files[i]))
+	 ret = 0;
+   }
+
+   for (t = 0; t < threads; t++)
+      pthread_join(tids[t], NULL);
+
+   return ret;
+}
+
+/**
+ * Copy a pseudonymized file to the standard output and close it.
+ * @param f input file
+ * @return 1 on success or 0 on failure
+ */
+static int para_output(para_file_t * f)
+{
+   char buf[PARA_COPY_SIZE];
+   size_t len;
+   int ret = 1;
+
+   if (!f->tmp)
+      return !f->failed;
+
+   while ((len = fread(buf, 1, sizeof(buf), f->tmp)) > 0) {
+      if (fwrite(buf, 1, len, stdout) != len) {
+	 err_msg("fwrite");
+	 ret = 0;
+	 break;
+      }
+   }
+
+   fclose(f->tmp);
+   f->tmp = NULL;
+   return ret && !f->failed;
+}
+
+/**
+ * Pseudonymize the given files in parallel and write the result to the
+ * standard output. The mapping tables must not be used before this call.
+ * @param names names of input files
+ * @param n number of input files
+ * @param threads number of threads
+ * @return 1 on success or 0 on failure, including truncated inputs and
+ * skipped corrupt data
+ */
+int para_run(char **names, int n, int threads)
+{
+   hash_table_t *(*sets)[FIELDS];
+   int i, t, ret;
+
+   if (threads > n)
+      threads = n;
+   if (threads > PARA_MAX_THREADS)
+      threads = PARA_MAX_THREADS;
+
+   files = calloc(n, sizeof(para_file_t));
+   sets = malloc(sizeof(*sets) * threads);
+   if (!files || !sets) {
+      err_msg("Failed to allocate memory");
+      return 0;
+   }
+
+   nfiles = n;
+   for (i = 0; i < n; i++)
+      files[i].name = names[i];
+
+   for (t = 0; t < threads; t++)
+      for (i = 0; i < FIELDS; i++)
+	 if (!(sets[t][i] = hash_create(1024, NULL, AUTO_REHASH))) {
+	    err_msg("Failed to allocate memory");
+	    return 0;
+	 }
+
+   /*
+    * First pass: collect, merge and map all fields.
+    */
+   para_pass(para_scan, (char *) sets, sizeof(*sets), threads, NULL);
+   para_merge(sets, threads);
+   ret = para_assign(sets[0]);
+   free(sets);
+
+   if (!ret) {
+      err_msg("Failed to allocate memory");
+      return 0;
+   }
+
+   if (verbose)
+      fprintf(stderr, "[para] %d files mapped with %d threads\n", n,
+	      threads);
+
+   /*
+    * Second pass: rewrite all files against the complete mapping.
+    */
+   ret = para_pass(para_rewrite, NULL, 0, threads, para_output);
+   fflush(stdout);
+
+   free(files);
+   return ret;
+}
@@ -0,0 +1,57 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file para.h Parallel two-pass pseudonymization header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _PARA_H
+#define _PARA_H
+
+#define PARA_MAX_THREADS  64		/**< Maximum number of threads */
+#define PARA_COPY_SIZE    65536		/**< Block size for concatenation */
+
+/**
+ * Distinct field collected during the first pass. The key is stored
+ * inline after the length.
+ */
+typedef struct {
+   ushort_t len;		     /**< Length of field */
+   uchar_t key[1];		     /**< Field */
+} para_key_t;
+
+/**
+ * Input file of the parallel mode.
+ */
+typedef struct {
+   char *name;			     /**< Name of file */
+   int valid;			     /**< File is an audit trail */
+   int done;			     /**< Second pass has finished */
+   int failed;			     /**< Data has been dropped */
+   FILE *tmp;			     /**< Pseudonymized output or NULL */
+} para_file_t;
+
+int para_run(char **names, int n, int threads);
+
+#endif				/* _PARA_H */
@@ -0,0 +1,399 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file part.c Partitioned output.
+ * Instead of one stream, the pseudonymized records can be written to a
+ * number of partition files, so that jobs interested in single users or
+ * classes of events only read their partition. A record is routed by the
+ * pseudonymized audit user ID of its first subject modulo the number of
+ * partitions, or by the number of the first audit class of its event
+ * modulo the number of partitions. Tokens outside of records, e.g. file
+ * tokens, are written to all partitions, so that each partition is an
+ * audit trail of its own.
+ *
+ * Each partition is written by a thread of its own, which also compresses
+ * the data if requested.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "field.h"
+#include "bsm.h"
+#include "emit.h"
+#include "filter.h"
+#include "part.h"
+#include "config.h"
+
+/**
+ * Thread of a partition writer. Handed buffers are written until the
+ * writer is stopped.
+ * @param arg writer
+ * @return NULL
+ */
+static void *part_thread(void *arg)
+{
+   part_writer_t *w = arg;
+   int ok;
+
+   pthread_mutex_lock(&w->lock);
+   for (;;) {
+      while (!w->busy && !w->stop)
+	 pthread_cond_wait(&w->cond, &w->lock);
+      if (!w->busy)
+	 break;
+
+      pthread_mutex_unlock(&w->lock);
+      ok = bsm_write(&w->out, w->full, w->full_len);
+      pthread_mutex_lock(&w->lock);
+
+      if (!ok)
+	 w->failed = 1;
+      w->busy = 0;
+      pthread_cond_broadcast(&w->cond);
+   }
+   pthread_mutex_unlock(&w->lock);
+
+   return NULL;
+}
+
+/**
+ * Hand the filled buffer of a writer to its thread. The call waits until
+ * the thread has written the previous buffer, which then becomes the
+ * buffer to fill.
+ * @param w writer
+ * @return 1 on success or 0 if writing has failed
+ */
+static int part_handoff(part_writer_t * w)
+{
+   char *tmp;
+   int size;
+
+   pthread_mutex_lock(&w->lock);
+   while (w->busy)
+      pthread_cond_wait(&w->cond, &w->lock);
+
+   if (w->failed) {
+      pthread_mutex_unlock(&w->lock);
+      return 0;
+   }
+
+   tmp = w->full;
+   size = w->full_size;
+   w->full = w->fill;
+   w->full_size = w->fill_size;
+   w->full_len = w->fill_len;
+   w->fill = tmp;
+   w->fill_size = size;
+   w->fill_len = 0;
+
+   w->busy = 1;
+   pthread_cond_broadcast(&w->cond);
+   pthread_mutex_unlock(&w->lock);
+
+   return 1;
+}
+
+/**
+ * Append data to the buffer of a writer.
+ * @param w writer
+ * @param buf data
+ * @param len length of data
+ * @return 1 on success or 0 on failure
+ */
+static int part_append(part_writer_t * w, char *buf, int len)
+{
+   char *tmp;
+
+   if (w->fill_len + len > w->fill_size) {
+      if (w->fill_len && !part_handoff(w))
+	 return 0;
+
+      if (len > w->fill_size) {
+	 if (!(tmp = realloc(w->fill, len))) {
+	    err_msg("Failed to allocate memory");
+	    return 0;
+	 }
+	 w->fill = tmp;
+	 w->fill_size = len;
+      }
+   }
+
+   memcpy(w->fill + w->fill_len, buf, len);
+   w->fill_len += len;
+   return 1;
+}
+
+/**
+ * Open a partition writer.
+ * @param w writer
+ * @param name name of partition file
+ * @param compress compress output using zlib
+ * @return 1 on success or 0 on failure
+ */
+static int part_writer_open(part_writer_t * w, char *name, int compress)
+{
+   int fd;
+
+   if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+      err_msg("Could not open %s", name);
+      return 0;
+   }
+
+   /*
+    * Up to PART_MAX files are open at once, thus neither extents nor
+    * queued blocks are reserved for each of them.
+    */
+   if (!bsm_out_open(&w->out, fd, compress ? OUT_ZLIB : OUT_PLAIN,
+		     EMIT_BSM)) {
+      err_msg("Could not open %s", name);
+      close(fd);
+      return 0;
+   }
+
+   w->fill = malloc(PART_BUFFER);
+   w->full = malloc(PART_BUFFER);
+   if (!w->fill || !w->full) {
+      err_msg("Failed to allocate memory");
+      goto err;
+   }
+   w->fill_size = w->full_size = PART_BUFFER;
+
+   pthread_mutex_init(&w->lock, NULL);
+   pthread_cond_init(&w->cond, NULL);
+   if (pthread_create(&w->thread, NULL, part_thread, w)) {
+      err_msg("Could not create thread");
+      pthread_mutex_destroy(&w->lock);
+      pthread_cond_destroy(&w->cond);
+      goto err;
+   }
+
+   return 1;
+
+ err:
+   free(w->fill);
+   free(w->full);
+   bsm_out_close(&w->out);
+   return 0;
+}
+
+/**
+ * Flush and close a partition writer.
+ * @param w writer
+ * @return 1 on success or 0 on failure
+ */
+static int part_writer_close(part_writer_t * w)
+{
+   int ret = 1;
+
+   if (w->fill_len && !part_handoff(w))
+      ret = 0;
+
+   pthread_mutex_lock(&w->lock);
+   w->stop = 1;
+   pthread_cond_broadcast(&w->cond);
+   pthread_mutex_unlock(&w->lock);
+   pthread_join(w->thread, NULL);
+
+   if (w->failed || !bsm_out_close(&w->out))
+      ret = 0;
+
+   pthread_mutex_destroy(&w->lock);
+   pthread_cond_destroy(&w->cond);
+   free(w->fill);
+   free(w->full);
+   return ret;
+}
+
+/**
+ * Open a partitioned output. The specification has the form key:n:prefix,
+ * where key is user or class, n is the number of partitions and the
+ * partitions are written to the files prefix.0 to prefix.n-1.
+ * @param spec specification of partitions
+ * @param compress compress partitions using zlib
+ * @return partitioned output or NULL on failure
+ */
+part_t *part_open(char *spec, int compress)
+{
+   char *num, *prefix, *name;
+   part_t *p;
+   int i;
+
+   if (!(num = strchr(spec, ':')) || !(prefix = strchr(num + 1, ':')) ||
+       !prefix[1]) {
+      err_msg("Invalid partitioning %s", spec);
+      return NULL;
+   }
+   *num++ = 0;
+   *prefix++ = 0;
+
+   if (!(p = calloc(1, sizeof(part_t)))) {
+      err_msg("Failed to allocate memory");
+      return NULL;
+   }
+
+   if (!strcmp(spec, "user"))
+      p->key = PART_USER;
+   else if (!strcmp(spec, "class"))
+      p->key = PART_CLASS;
+   else {
+      err_msg("Unknown partition key %s", spec);
+      free(p);
+      return NULL;
+   }
+
+   p->num = atoi(num);
+   if (p->num < 1 || p->num > PART_MAX) {
+      err_msg("Number of partitions must be between 1 and %d", PART_MAX);
+      free(p);
+      return NULL;
+   }
+
+   if (p->key == PART_CLASS && !(p->classes = filter_class_table())) {
+      free(p);
+      return NULL;
+   }
+
+   p->writers = calloc(p->num, sizeof(part_writer_t));
+   name = malloc(strlen(prefix) + 16);
+   if (!p->writers || !name) {
+      err_msg("Failed to allocate memory");
+      goto err;
+   }
+
+   for (i = 0; i < p->num; i++) {
+      sprintf(name, "%s.%d", prefix, i);
+      if (!part_writer_open(&p->writers[i], name, compress)) {
+	 p->num = i;
+	 part_close(p);
+	 free(name);
+	 return NULL;
+      }
+   }
+
+   free(name);
+   return p;
+
+ err:
+   free(name);
+   free(p->writers);
+   free(p->classes);
+   free(p);
+   return NULL;
+}
+
+/**
+ * Note the fields of a pseudonymized token that determine the partition
+ * of its record.
+ * @param p partitioned output
+ * @param buf buffer containing a token
+ */
+void part_token(part_t * p, uchar_t * buf)
+{
+   switch (buf[0]) {
+   case AUT_HEADER32:
+   case AUT_HEADER32_EX:
+   case AUT_HEADER64:
+   case AUT_HEADER64_EX:
+      p->event = field_get16(buf + 6);
+      p->auid = PART_NO_AUID;
+      p->subject = 0;
+      break;
+   case AUT_SUBJECT32:
+   case AUT_SUBJECT64:
+   case AUT_SUBJECT32_EX:
+   case AUT_SUBJECT64_EX:
+      if (!p->subject)
+	 p->auid = field_get32(buf + 1);
+      p->subject = 1;
+      break;
+   }
+}
+
+/**
+ * Write a record to its partition.
+ * @param p partitioned output
+ * @param rec record
+ * @param len length of record
+ * @return 1 on success or 0 on failure
+ */
+int part_record(part_t * p, char *rec, int len)
+{
+   unsigned int i;
+
+   if (p->key == PART_USER)
+      i = p->auid % p->num;
+   else
+      i = p->classes[p->event] % p->num;
+
+   return part_append(&p->writers[i], rec, len);
+}
+
+/**
+ * Write data outside of records to all partitions.
+ * @param p partitioned output
+ * @param buf data
+ * @param len length of data
+ * @return 1 on success or 0 on failure
+ */
+int part_broadcast(part_t * p, char *buf, int len)
+{
+   int i, ret = 1;
+
+   for (i = 0; i < p->num; i++)
+      if (!part_append(&p->writers[i], buf, len))
+	 ret = 0;
+
+   return ret;
+}
+
+/**
+ * Flush and close all partitions.
+ * @param p partitioned output
+ * @return 1 on success or 0 on failure
+ */
+int part_close(part_t * p)
+{
+   int i, ret = 1;
+
+   for (i = 0; i < p->num; i++)
+      if (!part_writer_close(&p->writers[i]))
+	 ret = 0;
+
+   free(p->writers);
+   free(p->classes);
+   free(p);
+   return ret;
+}
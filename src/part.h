@@ -0,0 +1,79 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file part.h Partitioned output header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _PART_H
+#define _PART_H
+
+#define PART_USER         0		/**< Partition by audit user ID */
+#define PART_CLASS        1		/**< Partition by audit class */
+#define PART_MAX          1024		/**< Maximum number of partitions */
+#define PART_BUFFER       (1 << 20)	/**< Size of a write buffer */
+#define PART_NO_AUID      0xffffffff	/**< Audit user ID without subject */
+
+/**
+ * Writer of a partition. Records are collected in a buffer that is handed
+ * to the thread of the writer when it is full, while the next buffer is
+ * filled.
+ */
+typedef struct {
+   bsm_out_t out;		     /**< Output of partition */
+   pthread_t thread;		     /**< Writing thread */
+   pthread_mutex_t lock;	     /**< Lock of handed buffer */
+   pthread_cond_t cond;		     /**< Change of handed buffer */
+   char *fill;			     /**< Buffer being filled */
+   int fill_len;		     /**< Length of data in fill */
+   int fill_size;		     /**< Size of fill */
+   char *full;			     /**< Buffer handed to the thread */
+   int full_len;		     /**< Length of data in full */
+   int full_size;		     /**< Size of full */
+   int busy;			     /**< Thread is writing full */
+   int stop;			     /**< Thread has to stop */
+   int failed;			     /**< Writing has failed */
+} part_writer_t;
+
+/**
+ * Partitioned output. Each record is routed to a partition by the audit
+ * user ID of its subject or by the audit class of its event.
+ */
+typedef struct s_part {
+   int key;			     /**< PART_USER or PART_CLASS */
+   int num;			     /**< Number of partitions */
+   ushort_t *classes;		     /**< Class of each event */
+   ushort_t event;		     /**< Event of current record */
+   uint32_t auid;		     /**< Audit user ID of current record */
+   int subject;			     /**< Subject of record has been seen */
+   part_writer_t *writers;	     /**< Writers of partitions */
+} part_t;
+
+part_t *part_open(char *spec, int compress);
+void part_token(part_t * p, uchar_t * buf);
+int part_record(part_t * p, char *rec, int len);
+int part_broadcast(part_t * p, char *buf, int len);
+int part_close(part_t * p);
+
+#endif				/* _PART_H */
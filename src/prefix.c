@@ -0,0 +1,279 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file prefix.c Prefix-preserving address pseudonymization.
+ * The scheme follows Crypto-PAn: bit i of an address is flipped if a
+ * keyed pseudo-random function of the first i bits says so. Two addresses
+ * sharing a prefix of n bits are thus mapped to pseudonyms sharing a
+ * prefix of exactly n bits, which keeps the subnet structure intact.
+ * Instead of AES, SipHash-2-4 serves as PRF.
+ *
+ * The decisions for the network part of the addresses are cached in a
+ * binary tree, so addresses from a known subnet cost a walk down the tree
+ * and only the host part is computed. Nodes are published with a single
+ * compare-and-swap and the decision of a node only depends on its prefix,
+ * thus the tree can be extended concurrently without locks.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefix.h"
+#include "config.h"
+
+#define ROTL(x, b)  (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND do { \
+   v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+   v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+   v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+   v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+} while (0)
+
+/**
+ * Compute SipHash-2-4 of a message.
+ * @param k0 first half of key
+ * @param k1 second half of key
+ * @param data message
+ * @param len length of message
+ * @return hash value
+ */
+static unsigned long long prefix_siphash(unsigned long long k0,
+					 unsigned long long k1,
+					 unsigned char *data, unsigned int len)
+{
+   unsigned long long v0, v1, v2, v3, m;
+   unsigned int i, j;
+
+   v0 = k0 ^ 0x736f6d6570736575ULL;
+   v1 = k1 ^ 0x646f72616e646f6dULL;
+   v2 = k0 ^ 0x6c7967656e657261ULL;
+   v3 = k1 ^ 0x7465646279746573ULL;
+
+   for (i = 0; i + 8 <= len; i += 8) {
+      for (m = 0, j = 0; j < 8; j++)
+	 m |= (unsigned long long) data[i + j] << (8 * j);
+      v3 ^= m;
+      SIPROUND;
+      SIPROUND;
+      v0 ^= m;
+   }
+
+   m = (unsigned long long) len << 56;
+   for (j = 0; i + j < len; j++)
+      m |= (unsigned long long) data[i + j] << (8 * j);
+
+   v3 ^= m;
+   SIPROUND;
+   SIPROUND;
+   v0 ^= m;
+
+   v2 ^= 0xff;
+   SIPROUND;
+   SIPROUND;
+   SIPROUND;
+   SIPROUND;
+
+   return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * Decide whether the bit following a prefix is flipped.
+ * @param p_prefix pseudonymizer
+ * @param addr address holding the prefix
+ * @param len length of address
+ * @param bits length of prefix in bits
+ * @return 1 if the bit is flipped or 0 otherwise
+ */
+static unsigned char prefix_flip(prefix_t * p_prefix, unsigned char *addr,
+				 int len, int bits)
+{
+   unsigned char msg[18];
+   int n;
+
+   /*
+    * The message is the prefix padded with zeros, followed by the length
+    * of the prefix and the address family.
+    */
+   memset(msg, 0, sizeof(msg));
+   n = bits / 8;
+   memcpy(msg, addr, n);
+   if (bits % 8)
+      msg[n] = addr[n] & (0xff << (8 - bits % 8));
+
+   msg[16] = bits;
+   msg[17] = len;
+
+   return prefix_siphash(p_prefix->k0, p_prefix->k1, msg, 18) >> 63;
+}
+
+/**
+ * Create a node of the prefix tree.
+ * @param p_prefix pseudonymizer
+ * @param addr address holding the prefix of the node
+ * @param len length of address
+ * @param bits length of prefix in bits
+ * @return node or NULL on failure
+ */
+static prefix_node_t *prefix_node(prefix_t * p_prefix, unsigned char *addr,
+				  int len, int bits)
+{
+   prefix_node_t *p_node;
+
+   if (!(p_node = malloc(sizeof(prefix_node_t))))
+      return NULL;
+
+   p_node->p_child[0] = p_node->p_child[1] = NULL;
+   p_node->i_flip = prefix_flip(p_prefix, addr, len, bits);
+
+   return p_node;
+}
+
+/**
+ * Create a new prefix-preserving pseudonymizer.
+ * @param key key of PREFIX_KEY_SIZE bytes
+ * @return pseudonymizer or NULL on failure
+ */
+prefix_t *prefix_create(unsigned char *key)
+{
+   prefix_t *p_prefix;
+   unsigned char zero[16];
+   int i;
+
+   if (!(p_prefix = malloc(sizeof(prefix_t))))
+      return NULL;
+
+   p_prefix->k0 = p_prefix->k1 = 0;
+   for (i = 0; i < 8; i++) {
+      p_prefix->k0 |= (unsigned long long) key[i] << (8 * i);
+      p_prefix->k1 |= (unsigned long long) key[i + 8] << (8 * i);
+   }
+
+   memset(zero, 0, sizeof(zero));
+   p_prefix->p_v4 = prefix_node(p_prefix, zero, 4, 0);
+   p_prefix->p_v6 = prefix_node(p_prefix, zero, 16, 0);
+   p_prefix->i_nodes = 2;
+
+   if (!p_prefix->p_v4 || !p_prefix->p_v6) {
+      prefix_finalize(p_prefix);
+      return NULL;
+   }
+
+   return p_prefix;
+}
+
+/**
+ * Map an address to its prefix-preserving pseudonym. The decisions for
+ * the first PREFIX_DEPTH_V4 or PREFIX_DEPTH_V6 bits are taken from the
+ * tree and added to it if missing, the remaining bits are computed.
+ * @param p_prefix pseudonymizer
+ * @param addr address
+ * @param len length of address, either 4 or 16
+ * @param out buffer for pseudonym of len bytes
+ * @return 1 on success or 0 on failure
+ */
+int prefix_map(prefix_t * p_prefix, unsigned char *addr, int len,
+	       unsigned char *out)
+{
+   prefix_node_t *p_node, *p_next, *p_new;
+   unsigned char flip, bit;
+   int i, depth;
+
+   if (len == 4) {
+      p_node = p_prefix->p_v4;
+      depth = PREFIX_DEPTH_V4;
+   } else if (len == 16) {
+      p_node = p_prefix->p_v6;
+      depth = PREFIX_DEPTH_V6;
+   } else
+      return 0;
+
+   memset(out, 0, len);
+   for (i = 0; i < len * 8; i++) {
+      bit = (addr[i / 8] >> (7 - i % 8)) & 1;
+
+      if (p_node) {
+	 flip = p_node->i_flip;
+
+	 /*
+	  * Descend, publishing the child if it is missing. If another
+	  * thread has been faster, its identical child is used instead.
+	  */
+	 p_next = NULL;
+	 if (i + 1 < depth) {
+	    p_next = __atomic_load_n(&p_node->p_child[bit], __ATOMIC_ACQUIRE);
+	    if (!p_next) {
+	       if (!(p_new = prefix_node(p_prefix, addr, len, i + 1)))
+		  return 0;
+
+	       if (__atomic_compare_exchange_n(&p_node->p_child[bit],
+					       &p_next, p_new, 0,
+					       __ATOMIC_RELEASE,
+					       __ATOMIC_ACQUIRE)) {
+		  __atomic_add_fetch(&p_prefix->i_nodes, 1,
+				     __ATOMIC_RELAXED);
+		  p_next = p_new;
+	       } else
+		  free(p_new);
+	    }
+	 }
+	 p_node = p_next;
+      } else
+	 flip = prefix_flip(p_prefix, addr, len, i);
+
+      out[i / 8] |= (bit ^ flip) << (7 - i % 8);
+   }
+
+   return 1;
+}
+
+/**
+ * Free the nodes of a subtree.
+ * @param p_node root of subtree
+ */
+static void prefix_free(prefix_node_t * p_node)
+{
+   if (!p_node)
+      return;
+
+   prefix_free(p_node->p_child[0]);
+   prefix_free(p_node->p_child[1]);
+   free(p_node);
+}
+
+/**
+ * Free a pseudonymizer and its trees. The pseudonymizer must not be
+ * accessed by other threads during this call.
+ * @param p_prefix pseudonymizer
+ */
+void prefix_finalize(prefix_t * p_prefix)
+{
+   if (!p_prefix)
+      return;
+
+   prefix_free(p_prefix->p_v4);
+   prefix_free(p_prefix->p_v6);
+   free(p_prefix);
+}
@@ -0,0 +1,62 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file prefix.h Prefix-preserving address pseudonymization header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _PREFIX_H
+#define _PREFIX_H
+
+#define PREFIX_KEY_SIZE    16		/**< Size of the key in bytes */
+#define PREFIX_DEPTH_V4    24		/**< Cached prefix bits of IPv4 */
+#define PREFIX_DEPTH_V6    64		/**< Cached prefix bits of IPv6 */
+
+/**
+ * Node of the prefix tree. A node at depth d holds the decision for the
+ * d-bit prefix leading to it, i.e. whether bit d of addresses with this
+ * prefix is flipped.
+ */
+typedef struct s_prefix_node {
+   struct s_prefix_node *p_child[2]; /**< Children for bit 0 and 1 */
+   unsigned char i_flip;	     /**< Flip the next bit */
+} prefix_node_t;
+
+/**
+ * Prefix-preserving pseudonymizer. IPv4 and IPv6 addresses use separate
+ * trees.
+ */
+typedef struct {
+   unsigned long long k0, k1;	     /**< Key of the PRF */
+   prefix_node_t *p_v4;		     /**< Tree of IPv4 prefixes */
+   prefix_node_t *p_v6;		     /**< Tree of IPv6 prefixes */
+   unsigned long i_nodes;	     /**< Number of nodes */
+} prefix_t;
+
+prefix_t *prefix_create(unsigned char *key);
+int prefix_map(prefix_t * p_prefix, unsigned char *addr, int len,
+	       unsigned char *out);
+void prefix_finalize(prefix_t * p_prefix);
+
+#endif				/* _PREFIX_H */
@@ -22,8 +22,8 @@
 /** 
  * @file pseu.c Anonymize functions. 
  * This file contains routines to pseudonymize uids, gids, pids, pathnames and
- * inet addresses. The mapping is kept within hash tables and might be saved
- * to a file in order to reconstruct the original audit logs.
+ * inet addresses. The mapping is kept within concurrent mapping tables, so
+ * that lookups never block and a mapping, once inserted, never changes.
  *
  * @author Konrad Rieck
  * @version $Id: pseu.c,v 3.1 2003/02/27 17:11:32 kr Exp $
@@ -32,6 +32,7 @@
 #include <sys/types.h>
 #include <bsm/audit.h>
 #include <bsm/audit_record.h>
+#include <bsm/audit_kevents.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -41,12 +42,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <math.h>
+#include <pthread.h>
 #include <zlib.h>
 
 #include "misc.h"
-#include "hash.h"
-#include "pseu.h"
+#include "cmap.h"
+#include "spill.h"
+#include "hll.h"
+#include "prefix.h"
+#include "kern.h"
+#include "field.h"
 #include "bsm.h"
+#include "emit.h"
+#include "cols.h"
+#include "idx.h"
+#include "part.h"
+#include "rot.h"
+#include "pseu.h"
 #include "rand.h"
 #include "config.h"
 
@@ -54,31 +67,80 @@ extern int verbose;
 extern int pseudonymize_pids, pseudonymize_uids, pseudonymize_gids;
 extern int pseudonymize_time, pseudonymize_paths, pseudonymize_addrs;
 extern int pseudonymize_args;
+extern unsigned long path_memory;
+extern int retire_pids;
+extern int prefix_addrs;
+extern int resync;
 
 /*
  * Global and static variables
  */
-static hash_table_t *uid_hash;		/**< Hash table for uid mapping */
-static hash_table_t *gid_hash;		/**< Hash table for gid mapping */
-static hash_table_t *pid_hash;		/**< Hash table for pid mapping */
-static hash_table_t *path_hash;		/**< Hash table for path mapping */
-static hash_table_t *addr_hash;		/**< Hash table for address mapping */
+static cmap_t *uid_hash;		/**< Hash table for uid mapping */
+static cmap_t *gid_hash;		/**< Hash table for gid mapping */
+static cmap_t *pid_hash;		/**< Hash table for pid mapping */
+static cmap_t *path_hash;		/**< Hash table for path mapping */
+static cmap_t *addr_hash;		/**< Hash table for address mapping */
+static spill_t *path_spill;		/**< Spill store for path mapping */
+static prefix_t *addr_prefix;		/**< Prefix-preserving addresses */
 
 static uid_t uid_min, uid_max;		/**< Minimum and maximum uid */
 static gid_t gid_min, gid_max;		/**< Minimum and maximum gid */
 static pid_t pid_min, pid_max;		/**< Minimum and maximum pid */
 static char **pathnames;		/**< List of pathname prefixes */
+static int *pathlens;			/**< Lengths of pathname prefixes */
 static long shift_max;			/**< Maximum time shift */
 
-static long byte_count;			/**< Counts written bytes */
+static ushort_t rec_event;		/**< Event type of current record */
+static uchar_t rec_pid[4];		/**< Original pid of current subject */
+static int rec_pid_valid;		/**< Subject pid has been seen */
+
+static hll_t sketch[FIELDS];		/**< Sketches of distinct fields */
+static rand_t rng;			/**< Generator of all pseudonyms */
+
+static uchar_t drop_types[256];		/**< Token types to be dropped */
+static int drop_any = 0;		/**< Some token type is dropped */
+
+/**
+ * Names of token types that can be dropped.
+ */
+static struct {
+   char *name;
+   uchar_t id;
+} token_names[] = {
+   {"data", AUT_DATA},
+   {"ipc", AUT_IPC},
+   {"path", AUT_PATH},
+   {"subject32", AUT_SUBJECT32},
+   {"process32", AUT_PROCESS32},
+   {"return32", AUT_RETURN32},
+   {"text", AUT_TEXT},
+   {"opaque", AUT_OPAQUE},
+   {"in_addr", AUT_IN_ADDR},
+   {"ip", AUT_IP},
+   {"iport", AUT_IPORT},
+   {"arg32", AUT_ARG32},
+   {"socket", AUT_SOCKET},
+   {"seq", AUT_SEQ},
+   {"ipc_perm", AUT_IPC_PERM},
+   {"groups", AUT_GROUPS},
+   {"exec_args", AUT_EXEC_ARGS},
+   {"exec_env", AUT_EXEC_ENV},
+   {"attr32", AUT_ATTR32},
+   {"exit", AUT_EXIT},
+   {"arg64", AUT_ARG64},
+   {"return64", AUT_RETURN64},
+   {"attr64", AUT_ATTR64},
+   {"subject64", AUT_SUBJECT64},
+   {"process64", AUT_PROCESS64},
+   {NULL, 0}
+};
 
 
 /**
  * Init the pseudonymize routines. Allocate memory for the different hash
  * tables used. The return value indicates if the initialing process and
- * allocation process was successful. All hash tables use the move to front
- * heuristic, due to the fact that uids, pids, etc... often appear in
- * redudant blocks.
+ * allocation process was successful. The hash tables are insert-only and
+ * can be read and extended concurrently without locking.
  * @param umi uid minimum
  * @param uma uid maximum
  * @param gmi gid minimum
@@ -87,17 +149,24 @@ static long byte_count;			/**< Counts written bytes */
  * @param pma pid maximum
  * @param list list of pathname prefixes
  * @param timeshift maximum time shift
+ * @param seed seed of the generator of pseudonyms
  * @return 1 on success or 0 on failure.
  */
 int pseu_init(int umi, int uma, int gmi, int gma, int pmi, int pma,
-	      char **list, long timeshift)
+	      char **list, long timeshift, unsigned long long seed)
 {
-   uid_hash = hash_create(UID_HASH_SIZE, NULL, HEU_MOVE_TO_FRONT);
-   gid_hash = hash_create(GID_HASH_SIZE, NULL, HEU_MOVE_TO_FRONT);
-   pid_hash = hash_create(PID_HASH_SIZE, NULL, HEU_MOVE_TO_FRONT);
+   uchar_t key[PREFIX_KEY_SIZE];
+   char *tmp;
+   int i;
+
+   rand_seed(&rng, seed);
+
+   uid_hash = cmap_create(UID_HASH_SIZE);
+   gid_hash = cmap_create(GID_HASH_SIZE);
+   pid_hash = cmap_create(PID_HASH_SIZE);
 
-   path_hash = hash_create(PATH_HASH_SIZE, NULL, HEU_MOVE_TO_FRONT);
-   addr_hash = hash_create(ADDR_HASH_SIZE, NULL, HEU_MOVE_TO_FRONT);
+   path_hash = cmap_create(PATH_HASH_SIZE);
+   addr_hash = cmap_create(ADDR_HASH_SIZE);
 
    uid_min = umi;
    uid_max = uma;
@@ -107,16 +176,45 @@ int pseu_init(int umi, int uma, int gmi, int gma, int pmi, int pma,
    pid_max = pma;
 
    pathnames = list;
+   for (i = 0; pathnames[i]; i++);
+   pathlens = malloc(sizeof(int) * (i + 1));
+   if (!pathlens)
+      return 0;
+   for (i = 0; pathnames[i]; i++)
+      pathlens[i] = strlen(pathnames[i]);
 
-   if (!uid_hash || !gid_hash || !path_hash || !addr_hash)
+   if (!uid_hash || !gid_hash || !pid_hash || !path_hash || !addr_hash)
       return 0;
 
-   byte_count = 0;
+   /*
+    * The path mapping grows with every unique pathname. If its memory is
+    * limited, cold mappings are spilled to a temporary file.
+    */
+   path_spill = NULL;
+   if (path_memory) {
+      tmp = getenv("TMPDIR");
+      path_spill = spill_create(tmp ? tmp : "/tmp");
+      if (!path_spill)
+	 return 0;
+   }
 
-   if (timeshift != 0)
-      shift_max = lrand48() % timeshift;
+   /*
+    * The key of the prefix-preserving address mapping is drawn like all
+    * other pseudonyms.
+    */
+   addr_prefix = NULL;
+   if (prefix_addrs) {
+      rand_fill(&rng, key, PREFIX_KEY_SIZE);
+      addr_prefix = prefix_create(key);
+      if (!addr_prefix)
+	 return 0;
+   }
 
-   
+   for (i = 0; i < FIELDS; i++)
+      hll_init(&sketch[i]);
+
+   if (timeshift != 0)
+      shift_max = rand_next(&rng) % timeshift;
 
    return 1;
 }
@@ -127,33 +225,63 @@ int pseu_init(int umi, int uma, int gmi, int gma, int pmi, int pma,
  */
 void pseu_deinit()
 {
-   hash_iterator_t i;
-   void *p;
-
-   for (p = hash_first(uid_hash, &i); p; p = hash_next(uid_hash, &i)) {
-      free(p);
-   }
-   hash_finalize(uid_hash);
+   if (path_spill && verbose)
+      fprintf(stderr, "[spill] %u paths on disk, %u in memory\n",
+	      path_spill->i_items, path_hash->i_items);
+   spill_finalize(path_spill);
+
+   if (addr_prefix && verbose)
+      fprintf(stderr, "[prefix] %lu prefixes cached\n",
+	      addr_prefix->i_nodes);
+   prefix_finalize(addr_prefix);
+
+   cmap_finalize(uid_hash);
+   cmap_finalize(gid_hash);
+   cmap_finalize(pid_hash);
+   cmap_finalize(path_hash);
+   cmap_finalize(addr_hash);
+   free(pathlens);
+}
 
-   for (p = hash_first(gid_hash, &i); p; p = hash_next(gid_hash, &i)) {
-      free(p);
-   }
-   hash_finalize(gid_hash);
+/**
+ * Select token types that are dropped from the output. Records are then
+ * assembled before they are written and their byte counts are patched.
+ * Headers, trailers and file tokens can't be dropped.
+ * @param list comma-separated list of token names or numeric token IDs
+ * @return 1 on success or 0 on failure
+ */
+int pseu_drop(char *list)
+{
+   char *str, *end;
+   long id;
+   int i;
+
+   for (str = strtok(list, ","); str; str = strtok(NULL, ",")) {
+      id = strtol(str, &end, 0);
+      if (*end) {
+	 for (i = 0; token_names[i].name; i++)
+	    if (!strcmp(token_names[i].name, str))
+	       break;
+	 if (!token_names[i].name) {
+	    err_msg("Unknown token %s", str);
+	    return 0;
+	 }
+	 id = token_names[i].id;
+      }
 
-   for (p = hash_first(path_hash, &i); p; p = hash_next(path_hash, &i)) {
-      free(p);
-   }
-   hash_finalize(path_hash);
+      if (id <= 0 || id > 255 || id == AUT_TRAILER ||
+	  id == AUT_HEADER32 || id == AUT_HEADER32_EX ||
+	  id == AUT_HEADER64 || id == AUT_HEADER64_EX ||
+	  id == AUT_OTHER_FILE32 || id == AUT_OTHER_FILE64) {
+	 err_msg("Token %s can't be dropped", str);
+	 return 0;
+      }
 
-   for (p = hash_first(addr_hash, &i); p; p = hash_next(addr_hash, &i)) {
-      free(p);
+      drop_types[id] = 1;
+      drop_any = 1;
    }
-   hash_finalize(addr_hash);
 
-   for (p = hash_first(pid_hash, &i); p; p = hash_next(pid_hash, &i)) {
-      free(p);
-   }
-   hash_finalize(pid_hash);
+   return 1;
 }
 
 /**
@@ -164,33 +292,35 @@ void pseu_deinit()
  */
 void pseu_uid(uchar_t * u)
 {
-   uid_t *uid_ptr, uid, tuid;
+   uchar_t *uid_ptr, tmp[4];
+   uid_t uid, tuid;
 
-#if defined(_BIG_ENDIAN) || defined(WORDS_BIGENDIAN)
-   tuid = (u[0] << 24) + (u[1] << 16) + (u[2] << 8) + u[3];
-#else
-   tuid = (u[3] << 24) + (u[2] << 16) + (u[1] << 8) + u[0];
-#endif
+   tuid = field_get32(u);
 
    if (tuid < uid_min || tuid > uid_max)
       return;
 
-   uid_ptr = hash_get(uid_hash, sizeof(uid_t), u);
+   uid_ptr = cmap_get(uid_hash, sizeof(uid_t), u);
    if (!uid_ptr) {
-
-      uid = uid_rand(uid_min, uid_max);
+      uid = uid_rand(&rng, uid_min, uid_max);
+      field_put32(tmp, uid);
 
       /*
-       * Insert new uid into hash
+       * Insert new uid into hash. If another thread has been faster, its
+       * uid is returned and used instead.
        */
-      uid_ptr = (uid_t *) malloc(sizeof(uid_t));
-      memcpy(uid_ptr, &uid, sizeof(uid_t));
-      hash_insert(uid_hash, uid_ptr, sizeof(uid_t), u);
-
-      if (verbose)
-	 fprintf(stderr, "[map] uid %6ld -> %6lu (%u of %u)\n", tuid, uid,
-		 uid_hash->i_items, uid_hash->i_size);
+      uid_ptr = cmap_insert(uid_hash, sizeof(uid_t), u,
+			    sizeof(uid_t), tmp);
+      if (!uid_ptr) {
+	 err_msg("Failed to allocate memory");
+	 return;
+      }
 
+      if (verbose) {
+	 uid = field_get32(uid_ptr);
+	 fprintf(stderr, "[map] uid %6ld -> %6lu (%u of %u)\n", tuid,
+		 uid, uid_hash->i_items, uid_hash->i_size);
+      }
    }
 
    memcpy(u, uid_ptr, sizeof(uid_t));
@@ -204,31 +334,35 @@ void pseu_uid(uchar_t * u)
  */
 void pseu_gid(uchar_t * g)
 {
-   gid_t *gid_ptr, gid, tgid;
+   uchar_t *gid_ptr, tmp[4];
+   gid_t gid, tgid;
 
-#if defined(_BIG_ENDIAN) || defined(WORDS_BIGENDIAN)
-   tgid = (g[0] << 24) + (g[1] << 16) + (g[2] << 8) + g[3];
-#else
-   tgid = (g[3] << 24) + (g[2] << 16) + (g[1] << 8) + g[0];
-#endif
+   tgid = field_get32(g);
 
    if (tgid < gid_min || tgid > gid_max)
       return;
 
-   gid_ptr = hash_get(gid_hash, sizeof(gid_t), g);
+   gid_ptr = cmap_get(gid_hash, sizeof(gid_t), g);
    if (!gid_ptr) {
-      gid = gid_rand(gid_min, gid_max);
+      gid = gid_rand(&rng, gid_min, gid_max);
+      field_put32(tmp, gid);
 
       /*
-       * Insert new gid into hash
+       * Insert new gid into hash. If another thread has been faster, its
+       * gid is returned and used instead.
        */
-      gid_ptr = (gid_t *) malloc(sizeof(gid_t));
-      memcpy(gid_ptr, &gid, sizeof(gid_t));
-      hash_insert(gid_hash, gid_ptr, sizeof(gid_t), g);
+      gid_ptr = cmap_insert(gid_hash, sizeof(gid_t), g,
+			    sizeof(gid_t), tmp);
+      if (!gid_ptr) {
+	 err_msg("Failed to allocate memory");
+	 return;
+      }
 
-      if (verbose)
-	 fprintf(stderr, "[map] gid %6ld -> %6lu (%u of %u)\n", tgid, gid,
-		 gid_hash->i_items, gid_hash->i_size);
+      if (verbose) {
+	 gid = field_get32(gid_ptr);
+	 fprintf(stderr, "[map] gid %6ld -> %6lu (%u of %u)\n", tgid,
+		 gid, gid_hash->i_items, gid_hash->i_size);
+      }
    }
 
    memcpy(g, gid_ptr, sizeof(gid_t));
@@ -242,32 +376,35 @@ void pseu_gid(uchar_t * g)
  */
 void pseu_pid(uchar_t * p)
 {
-   pid_t *pid_ptr, pid, tpid;
+   uchar_t *pid_ptr, tmp[4];
+   pid_t pid, tpid;
 
-#if defined(_BIG_ENDIAN) || defined(WORDS_BIGENDIAN)
-   tpid = (p[0] << 24) + (p[1] << 16) + (p[2] << 8) + p[3];
-#else
-   tpid = (p[3] << 24) + (p[2] << 16) + (p[1] << 8) + p[0];
-#endif
+   tpid = field_get32(p);
 
    if (tpid < pid_min || tpid > pid_max)
       return;
 
-   pid_ptr = hash_get(pid_hash, sizeof(pid_t), p);
+   pid_ptr = cmap_get(pid_hash, sizeof(pid_t), p);
    if (!pid_ptr) {
-      pid = pid_rand(pid_min, pid_max);
+      pid = pid_rand(&rng, pid_min, pid_max);
+      field_put32(tmp, pid);
 
       /*
-       * Insert new pid into hash
+       * Insert new pid into hash. If another thread has been faster, its
+       * pid is returned and used instead.
        */
-      pid_ptr = (pid_t *) malloc(sizeof(pid_t));
-      memcpy(pid_ptr, &pid, sizeof(pid_t));
-      hash_insert(pid_hash, pid_ptr, sizeof(pid_t), p);
-
-      if (verbose)
-	 fprintf(stderr, "[map] pid %6ld -> %6lu (%u of %u)\n", tpid, pid,
-		 pid_hash->i_items, pid_hash->i_size);
+      pid_ptr = cmap_insert(pid_hash, sizeof(pid_t), p,
+			    sizeof(pid_t), tmp);
+      if (!pid_ptr) {
+	 err_msg("Failed to allocate memory");
+	 return;
+      }
 
+      if (verbose) {
+	 pid = field_get32(pid_ptr);
+	 fprintf(stderr, "[map] pid %6ld -> %6lu (%u of %u)\n", tpid,
+		 pid, pid_hash->i_items, pid_hash->i_size);
+      }
    }
 
    memcpy(p, pid_ptr, sizeof(pid_t));
@@ -356,17 +493,94 @@ void pseu_ids(uchar_t * buf)
    }
 }
 
+/**
+ * Decode the length of an inet address from its address type field.
+ * @param type Value of address type field
+ * @return length of address, either 4 or 16
+ */
+static ushort_t pseu_addr_len(uint32_t type)
+{
+   return type == AU_IPv6 ? 16 : 4;
+}
+
+/**
+ * Locate the inet addresses within a BSM token. The extended tokens carry
+ * an address type field in front of the address that determines whether
+ * an IPv4 or IPv6 address follows. Pseudonymizing and collecting tokens
+ * both use this function, so that they always agree on the fields.
+ * @param buf Buffer containing a BSM token.
+ * @param addr Array receiving pointers to at most two addresses
+ * @param len Array receiving the lengths of the addresses
+ * @return number of addresses within the token
+ */
+static int pseu_addr_fields(uchar_t * buf, uchar_t ** addr, ushort_t * len)
+{
+   switch (buf[0]) {
+   case AUT_HEADER32_EX:
+   case AUT_HEADER64_EX:
+      len[0] = pseu_addr_len(field_get32(buf + 10));
+      addr[0] = buf + 14;
+      return 1;
+   case AUT_PROCESS32:
+   case AUT_SUBJECT32:
+      len[0] = 4;
+      addr[0] = buf + 33;
+      return 1;
+   case AUT_PROCESS64:
+   case AUT_SUBJECT64:
+      len[0] = 4;
+      addr[0] = buf + 37;
+      return 1;
+   case AUT_PROCESS32_EX:
+   case AUT_SUBJECT32_EX:
+      len[0] = pseu_addr_len(field_get32(buf + 33));
+      addr[0] = buf + 37;
+      return 1;
+   case AUT_PROCESS64_EX:
+   case AUT_SUBJECT64_EX:
+      len[0] = pseu_addr_len(field_get32(buf + 37));
+      addr[0] = buf + 41;
+      return 1;
+   case AUT_IN_ADDR:
+      len[0] = 4;
+      addr[0] = buf + 1;
+      return 1;
+   case AUT_IN_ADDR_EX:
+      len[0] = pseu_addr_len(field_get32(buf + 1));
+      addr[0] = buf + 5;
+      return 1;
+   case AUT_SOCKET:
+      len[0] = 4;
+      addr[0] = buf + 5;
+      return 1;
+   case AUT_SOCKET_EX:
+      /*
+       * Domain, type and address type (2 bytes each) are followed by
+       * the local port and address and the remote port and address.
+       */
+      len[0] = len[1] = pseu_addr_len(field_get16(buf + 5));
+      addr[0] = buf + 9;
+      addr[1] = buf + 11 + len[0];
+      return 2;
+   }
+
+   return 0;
+}
+
 /**
  * Anonymize the internet address. The address can be IPv4 or IPv6 as
  * long as the correct size is supplied. The address 0.0.0.0 is not
- * pseudonymized since it refers to the local host.
+ * pseudonymized since it refers to the local host. Addresses are either
+ * replaced by random addresses or, if enabled, by prefix-preserving
+ * pseudonyms.
  * @see addr_rand
+ * @see prefix_map
  * @param addr Buffer for internet address
  * @param len Length of address, usually 4 or 16.
  */
 void pseu_addr(uchar_t * addr, ushort_t * len)
 {
-   uchar_t *addr_ptr, buf1[46], buf2[46];
+   uchar_t *addr_ptr, buf1[46], buf2[46], tmp[16];
    ushort_t length = *len, i, c;
 
    c = 0;
@@ -376,14 +590,18 @@ void pseu_addr(uchar_t * addr, ushort_t * len)
    if (c == 0)
       return;
 
-   addr_ptr = hash_get(addr_hash, length, addr);
+   addr_ptr = cmap_get(addr_hash, length, addr);
    if (!addr_ptr) {
       /*
        * Insert new inet addr into hash
        */
-      addr_ptr = (uchar_t *) malloc(length);
-      addr_ptr = addr_rand(length, addr_ptr);
-      hash_insert(addr_hash, addr_ptr, length, addr);
+      if (!addr_prefix || !prefix_map(addr_prefix, addr, length, tmp))
+	 addr_rand(&rng, length, tmp);
+      addr_ptr = cmap_insert(addr_hash, length, addr, length, tmp);
+      if (!addr_ptr) {
+	 err_msg("Failed to allocate memory");
+	 return;
+      }
 
       if (verbose) {
 	 if (length == 16)
@@ -410,94 +628,112 @@ void pseu_addr(uchar_t * addr, ushort_t * len)
  */
 void pseu_addrs(uchar_t * buf)
 {
-   uchar_t token_id;
-   ushort_t tmp;
+   uchar_t *addr[2];
+   ushort_t len[2];
+   int i, n;
 
-   token_id = buf[0];
+   n = pseu_addr_fields(buf, addr, len);
+   for (i = 0; i < n; i++)
+      pseu_addr(addr[i], &len[i]);
+}
 
-   switch (token_id) {
+/**
+ * Spill an evicted path mapping to disk. Mappings that cannot be spilled
+ * stay in memory; the first failure is reported.
+ * @param klen length of path
+ * @param key path
+ * @param dlen length of pseudonymized path
+ * @param data pseudonymized path
+ * @return 1 on success or 0 on failure
+ */
+int pseu_spill(unsigned int klen, void *key, unsigned int dlen, void *data)
+{
+   static int failed = 0;
 
-   case AUT_HEADER32_EX:
-   case AUT_HEADER64_EX:
-      fprintf(stderr, "Extended header support not implemented\n");
-      exit(EXIT_FAILURE);
+   if (spill_put(path_spill, klen, key, dlen, data))
+      return 1;
 
-      pseu_addr(buf + 12, (ushort_t *) buf + 10);
-      break;
-   case AUT_IP:
-      break;
-   case AUT_PROCESS32:
-   case AUT_SUBJECT32:
-      tmp = 4;
-      pseu_addr(buf + 33, &tmp);
-      break;
-   case AUT_PROCESS64:
-   case AUT_SUBJECT64:
-      tmp = 4;
-      pseu_addr(buf + 37, &tmp);
-      break;
-   case AUT_PROCESS32_EX:
-   case AUT_SUBJECT32_EX:
-      fprintf(stderr, "Extended subject(32) support not implemented\n");
-      exit(EXIT_FAILURE);
+   if (!failed)
+      err_msg("Could not spill path mapping, keeping it in memory");
+   failed = 1;
+   return 0;
+}
 
-      pseu_addr(buf + 35, (ushort_t *) buf + 33);
-      break;
-   case AUT_PROCESS64_EX:
-   case AUT_SUBJECT64_EX:
-      fprintf(stderr, "Extended subject(64) support not implemented\n");
-      exit(EXIT_FAILURE);
+/**
+ * Match a path against the pathname prefixes. Leading slashes are removed
+ * from the path, then the function checks if the path matches one of the
+ * prefixes in pathnames[].
+ * @param tpath buffer containg pathname
+ * @param prefix returns the length of the matching prefix
+ * @return path without leading slashes or NULL if no prefix matches
+ */
+uchar_t *pseu_match(uchar_t * tpath, int *prefix)
+{
+   uchar_t *path;
+   int i;
 
-      pseu_addr(buf + 39, (ushort_t *) buf + 37);
-      break;
-   case AUT_SOCKET:
-      tmp = 4;
-      pseu_addr(buf + 5, &tmp);
-      break;
-   case AUT_SOCKET_EX:
-      tmp = *(buf + 7);
-      pseu_addr(buf + 9, &tmp);
-      pseu_addr(buf + 9 + tmp, &tmp);
-      break;
+   path = tpath;
+   while (path[0] == '/' && path[1] == '/')
+      path++;
+
+   for (i = 0; pathnames[i]; i++) {
+      *prefix = pathlens[i];
+      if (!strncmp(pathnames[i], path, *prefix))
+	 return path;
    }
+
+   return NULL;
 }
 
 /**
  * Anonymize a path. Leading slashes are removed from the path, then the
  * function checks if the path matches on of the prefixes in pathnames[]. 
- * If it matches the matching path is pseudonymized
+ * If it matches the matching path is pseudonymized. If the memory of the
+ * path mapping is limited, mappings missing in memory are looked up in the
+ * spill store and faulted back, so that a path always gets the same
+ * pseudonym. The length of the path is computed once, the lengths of
+ * the prefixes are computed in pseu_init().
  * @see str_rand
  * @param tpath buffer containg pathname
  */
 void pseu_path(uchar_t * tpath)
 {
-   uchar_t *path_ptr, *path;
-   ushort_t i;
+   uchar_t *path_ptr, *path, *tmp;
+   unsigned int len, size;
    int j;
 
-   path = tpath;
-   while (path[0] == '/' && path[1] == '/')
-      path++;
+   path = pseu_match(tpath, &j);
+   if (!path)
+      return;
 
-   j = -1;
-   for (i = 0; j == -1 && pathnames[i]; i++) {
-      if (!strncmp(pathnames[i], path, strlen(pathnames[i]))) {
-	 j = i;
+   size = strlen(path) + 1;
+   path_ptr = cmap_get(path_hash, size, path);
+   if (!path_ptr && path_spill) {
+      tmp = spill_get(path_spill, size, path, &len);
+      if (tmp) {
+	 path_ptr = cmap_insert(path_hash, size, path, len, tmp);
+	 if (path_ptr)
+	    cmap_set_clean(path_ptr, size);
       }
    }
 
-   if (j == -1)
-      return;
-
-   path_ptr = hash_get(path_hash, strlen(path) + 1, path);
    if (!path_ptr) {
       /*
        * Insert new path into hash
        */
-      path_ptr = strdup(path);
-      str_rand(path_ptr + strlen(pathnames[j]), strlen(path) -
-	       strlen(pathnames[j]));
-      hash_insert(path_hash, path_ptr, strlen(path) + 1, path);
+      tmp = malloc(size);
+      if (!tmp) {
+	 err_msg("Failed to allocate memory");
+	 return;
+      }
+      memcpy(tmp, path, size);
+      str_rand(&rng, tmp + j, size - 1 - j);
+      path_ptr = cmap_insert(path_hash, size, path, size, tmp);
+      free(tmp);
+      if (!path_ptr) {
+	 err_msg("Failed to allocate memory");
+	 return;
+      }
 
       if (verbose) {
 	 fprintf(stderr, "[map] path %s -> %s (%u of %u)\n", path, path_ptr,
@@ -505,7 +741,17 @@ void pseu_path(uchar_t * tpath)
 
       }
    }
-   memcpy(path, path_ptr, strlen(path) + 1);
+   memcpy(path, path_ptr, size);
+
+   /*
+    * Evict cold mappings down to 90% of the limit in one batch.
+    */
+   if (path_spill && path_hash->i_bytes > path_memory) {
+      len = cmap_evict(path_hash, path_memory / 10 * 9, pseu_spill);
+      if (verbose)
+	 fprintf(stderr, "[spill] %u paths moved to disk (%u in memory)\n",
+		 len, path_hash->i_items);
+   }
 }
 
 
@@ -530,18 +776,22 @@ void pseu_paths(uchar_t * buf)
    }
 }
 
+/**
+ * Shift a 4 byte timestamp.
+ * @param b Pointer to timestamp
+ */
 void pseu_time(uchar_t * b)
 {
-   long time;
-#if defined(_BIG_ENDIAN) || defined(WORDS_BIGENDIAN)
-   time = (b[0] << 24) + (b[1] << 16) + (b[2] << 8) + b[3];
-#else
-   time = (b[3] << 24) + (b[2] << 16) + (b[1] << 8) + b[0];
-#endif
-
-   time -= shift_max;
+   field_put32(b, field_get32(b) - shift_max);
+}
 
-   memcpy(b, &time, 4);
+/**
+ * Shift an 8 byte timestamp of a 64 bit token.
+ * @param b Pointer to timestamp
+ */
+void pseu_time64(uchar_t * b)
+{
+   field_put64(b, field_get64(b) - shift_max);
 }
 
 /**
@@ -559,22 +809,25 @@ void pseu_times(uchar_t * buf)
 
    switch (token_id) {
    case AUT_OTHER_FILE32:
-   case AUT_OTHER_FILE64:
       pseu_time(buf + 1);
       break;
+   case AUT_OTHER_FILE64:
+      pseu_time64(buf + 1);
+      break;
    case AUT_HEADER32:
       pseu_time(buf + 10);
       break;
    case AUT_HEADER64:
-      pseu_time(buf + 14);
+      pseu_time64(buf + 10);
       break;
    case AUT_HEADER32_EX:
-      fprintf(stderr, "Extended header(32) support not implemented\n");
-      exit(EXIT_FAILURE);
+      /*
+       * The timestamp follows the variable sized host address.
+       */
+      pseu_time(buf + 14 + pseu_addr_len(field_get32(buf + 10)));
       break;
    case AUT_HEADER64_EX:
-      fprintf(stderr, "Extended header(64) support not implemented\n");
-      exit(EXIT_FAILURE);
+      pseu_time64(buf + 14 + pseu_addr_len(field_get32(buf + 10)));
       break;
    }
 }
@@ -583,22 +836,14 @@ void pseu_times(uchar_t * buf)
  * Clear the content of the exex args/env. 
  * @param buf buffer containg args/env
  * @param s pointer to the number of strings (4 byte).
+ * @param len length of buffer
  */
-void pseu_arg(uchar_t * buf, uchar_t * s)
+void pseu_arg(uchar_t * buf, uchar_t * s, int len)
 {
-   uint32_t count, i, j;
-
-#if defined(_BIG_ENDIAN) || defined(WORDS_BIGENDIAN)
-   count = (s[0] << 24) + (s[1] << 16) + (s[2] << 8) + s[3];
-#else
-   count = (s[3] << 24) + (s[2] << 16) + (s[1] << 8) + s[0];
-#endif
-
-   j = 0;
-   for (i = 0; i < count; i++, j++) {
-      while (buf[j])
-	 buf[j++] = ' ';
-   }
+   uint32_t count;
+
+   count = field_get32(s);
+   kern_blank(buf, kern_skip_nuls(buf, len, &count));
 }
 
 /**
@@ -607,8 +852,9 @@ void pseu_arg(uchar_t * buf, uchar_t * s)
  * first byte of the buffer. According to the type of token arguments
  * and environment are filled with spaces.
  * @param buf Buffer containing a BSM token.
+ * @param len Length of token
  */
-void pseu_args(uchar_t * buf)
+void pseu_args(uchar_t * buf, int len)
 {
    uchar_t token_id;
 
@@ -617,7 +863,327 @@ void pseu_args(uchar_t * buf)
    switch (token_id) {
    case AUT_EXEC_ENV:
    case AUT_EXEC_ARGS:
-      pseu_arg(buf + 5, buf + 1);
+      pseu_arg(buf + 5, buf + 1, len - 5);
+      break;
+   }
+}
+
+/**
+ * Retire a pid mapping. The pid is removed from the pid hash table, so
+ * that the next process using this pid gets a fresh pseudonym.
+ * @param p Pointer to a pid of type pid_t
+ */
+void pseu_unmap_pid(uchar_t * p)
+{
+   pid_t tpid;
+
+   if (!cmap_remove(pid_hash, sizeof(pid_t), p) || !verbose)
+      return;
+
+   tpid = field_get32(p);
+   fprintf(stderr, "[map] pid %6ld retired (%u of %u)\n", tpid,
+	   pid_hash->i_items, pid_hash->i_size);
+}
+
+/**
+ * Track the life cycle of processes. The buffer contains a BSM token that
+ * has not been pseudonymized yet. The event type of the record and the pid
+ * of its subject are remembered. When the trailer of an exit record is
+ * reached, the pid of the exiting process is retired. The child pid of a
+ * fork record is retired as well, since any mapping for it belongs to an
+ * earlier process, and is then mapped to a fresh pseudonym. Exec records
+ * keep the mapping, as the process lives on with a new image.
+ * @param buf Buffer containing a BSM token.
+ */
+void pseu_retire(uchar_t * buf)
+{
+   uchar_t token_id;
+
+   token_id = buf[0];
+
+   switch (token_id) {
+   case AUT_HEADER32:
+   case AUT_HEADER32_EX:
+   case AUT_HEADER64:
+   case AUT_HEADER64_EX:
+      rec_event = field_get16(buf + 6);
+      rec_pid_valid = 0;
+      break;
+   case AUT_SUBJECT32:
+   case AUT_SUBJECT64:
+   case AUT_SUBJECT32_EX:
+   case AUT_SUBJECT64_EX:
+      memcpy(rec_pid, buf + 21, sizeof(rec_pid));
+      rec_pid_valid = 1;
+      break;
+   case AUT_ARG32:
+      if (rec_event != AUE_FORK && rec_event != AUE_VFORK &&
+	  rec_event != AUE_FORK1 && rec_event != AUE_FORKALL)
+	 break;
+
+      pseu_unmap_pid(buf + 2);
+      if (pseudonymize_pids)
+	 pseu_pid(buf + 2);
+      break;
+   case AUT_TRAILER:
+      if (rec_event == AUE_EXIT && rec_pid_valid)
+	 pseu_unmap_pid(rec_pid);
+      rec_pid_valid = 0;
+      break;
+   }
+}
+
+/**
+ * Pass a uid, gid or pid field to a callback if it lies within the
+ * interval of pseudonymized ids.
+ * @param type type of field
+ * @param b Pointer to field
+ * @param fn callback
+ * @param arg argument passed to callback
+ */
+static void pseu_collect_id(int type, uchar_t * b, pseu_fn_field_t fn,
+			    void *arg)
+{
+   uint32_t id = field_get32(b);
+
+   switch (type) {
+   case FIELD_UID:
+      if (!pseudonymize_uids || id < uid_min || id > uid_max)
+	 return;
+      break;
+   case FIELD_GID:
+      if (!pseudonymize_gids || id < gid_min || id > gid_max)
+	 return;
+      break;
+   case FIELD_PID:
+      if (!pseudonymize_pids || id < pid_min || id > pid_max)
+	 return;
+      break;
+   }
+
+   fn(type, b, 4, arg);
+}
+
+/**
+ * Pass an inet address to a callback unless it is a local address.
+ * @param b Pointer to address
+ * @param len Length of address
+ * @param fn callback
+ * @param arg argument passed to callback
+ */
+static void pseu_collect_addr(uchar_t * b, ushort_t len, pseu_fn_field_t fn,
+			      void *arg)
+{
+   ushort_t i;
+
+   for (i = 0; i < len && !b[i]; i++);
+
+   if (i < len)
+      fn(FIELD_ADDR, b, len, arg);
+}
+
+/**
+ * Collect all fields of a token that are mapped to pseudonyms. The buffer
+ * contains a BSM token that is not modified. Each uid, gid, pid, inet
+ * address and pathname that pseudonymizing the token would map is passed
+ * to the callback, in the form it is used as key of the mapping. Tokens
+ * that are dropped are not collected.
+ * @param buf Buffer containing a BSM token.
+ * @param fn callback
+ * @param arg argument passed to callback
+ */
+void pseu_collect(uchar_t * buf, pseu_fn_field_t fn, void *arg)
+{
+   uchar_t *path, *addr[2];
+   ushort_t len[2];
+   int prefix, i, n;
+
+   if (drop_types[buf[0]])
+      return;
+
+   switch (buf[0]) {
+   case AUT_SUBJECT32:
+   case AUT_SUBJECT64:
+   case AUT_PROCESS32:
+   case AUT_PROCESS64:
+   case AUT_SUBJECT32_EX:
+   case AUT_SUBJECT64_EX:
+   case AUT_PROCESS32_EX:
+   case AUT_PROCESS64_EX:
+      pseu_collect_id(FIELD_UID, buf + 1, fn, arg);
+      pseu_collect_id(FIELD_UID, buf + 5, fn, arg);
+      pseu_collect_id(FIELD_GID, buf + 9, fn, arg);
+      pseu_collect_id(FIELD_UID, buf + 13, fn, arg);
+      pseu_collect_id(FIELD_GID, buf + 17, fn, arg);
+      pseu_collect_id(FIELD_PID, buf + 21, fn, arg);
+      break;
+   case AUT_ATTR32:
+   case AUT_ATTR64:
+      pseu_collect_id(FIELD_UID, buf + 5, fn, arg);
+      pseu_collect_id(FIELD_GID, buf + 9, fn, arg);
+      break;
+   case AUT_IPC_PERM:
+      pseu_collect_id(FIELD_UID, buf + 1, fn, arg);
+      pseu_collect_id(FIELD_GID, buf + 5, fn, arg);
+      pseu_collect_id(FIELD_UID, buf + 9, fn, arg);
+      pseu_collect_id(FIELD_GID, buf + 13, fn, arg);
+      break;
+   }
+
+   if (pseudonymize_addrs) {
+      n = pseu_addr_fields(buf, addr, len);
+      for (i = 0; i < n; i++)
+	 pseu_collect_addr(addr[i], len[i], fn, arg);
+   }
+
+   if (pseudonymize_paths && (buf[0] == AUT_PATH || buf[0] == AUT_TEXT)) {
+      path = pseu_match(buf + 3, &prefix);
+      if (path)
+	 fn(FIELD_PATH, path, strlen(path) + 1, arg);
+   }
+}
+
+/**
+ * Add a field to the sketch of its type.
+ * @param type type of field
+ * @param key field
+ * @param len length of field
+ * @param arg unused
+ */
+static void pseu_sketch(int type, uchar_t * key, ushort_t len, void *arg)
+{
+   hll_add(&sketch[type], key, len);
+}
+
+/**
+ * Scan the stream and estimate the number of distinct fields of each type
+ * that will be mapped. The tokens are read but not pseudonymized. The
+ * scan stops after the given number of bytes, if limit is not 0.
+ * @param in input stream
+ * @param limit maximum number of bytes to scan or 0
+ * @return number of scanned bytes
+ */
+long pseu_estimate(bsm_stream_t * in, long limit)
+{
+   uchar_t buf[BSM_TOKEN_MAX];
+   long bytes = 0;
+   int len;
+
+   while (!bsm_eof(in) && (!limit || bytes < limit)) {
+      len = BSM_TOKEN_MAX;
+      if (!bsm_read(in, buf, &len))
+	 break;
+
+      if (len && !(in->chunk & BSM_CHUNK_CONT))
+	 pseu_collect(buf, pseu_sketch, NULL);
+      bytes += len;
+   }
+
+   return bytes;
+}
+
+/**
+ * Size the hash tables for the given number of distinct fields of each
+ * type. The tables are never smaller than the default sizes. They are
+ * recreated, hence this function must be called before any token is
+ * pseudonymized.
+ * @param counts number of distinct fields indexed by field type
+ * @return 1 on success or 0 on failure.
+ */
+int pseu_resize(unsigned long *counts)
+{
+   cmap_t **maps[FIELDS];
+   char *names[FIELDS] = { "uids", "gids", "pids", "addrs", "paths" };
+   unsigned long sizes[FIELDS];
+   unsigned long n;
+   int i;
+
+   maps[FIELD_UID] = &uid_hash;
+   maps[FIELD_GID] = &gid_hash;
+   maps[FIELD_PID] = &pid_hash;
+   maps[FIELD_ADDR] = &addr_hash;
+   maps[FIELD_PATH] = &path_hash;
+
+   sizes[FIELD_UID] = UID_HASH_SIZE;
+   sizes[FIELD_GID] = GID_HASH_SIZE;
+   sizes[FIELD_PID] = PID_HASH_SIZE;
+   sizes[FIELD_ADDR] = ADDR_HASH_SIZE;
+   sizes[FIELD_PATH] = PATH_HASH_SIZE;
+
+   for (i = 0; i < FIELDS; i++) {
+      n = counts[i];
+
+      cmap_finalize(*maps[i]);
+      if (n + n / 4 + 16 > sizes[i])
+	 sizes[i] = n + n / 4 + 16;
+      *maps[i] = cmap_create(sizes[i]);
+      if (!*maps[i])
+	 return 0;
+
+      if (verbose)
+	 fprintf(stderr, "[size] %-5s %8lu distinct (%u buckets)\n",
+		 names[i], n, (*maps[i])->i_size);
+   }
+
+   return 1;
+}
+
+/**
+ * Size the hash tables according to the number of distinct fields
+ * estimated by pseu_estimate(). The estimates of a partial scan are
+ * scaled to the whole input. New fields become rarer as the input grows,
+ * thus the estimates grow with a power of the scale below one.
+ * @param scale ratio of input size to scanned bytes
+ * @return 1 on success or 0 on failure.
+ */
+int pseu_presize(double scale)
+{
+   unsigned long counts[FIELDS];
+   int i;
+
+   scale = pow(scale, ESTIMATE_GROWTH);
+   for (i = 0; i < FIELDS; i++)
+      counts[i] = (unsigned long) (hll_count(&sketch[i]) * scale + 0.5);
+
+   return pseu_resize(counts);
+}
+
+/**
+ * Map a field to its pseudonym. The field is given in the form passed to
+ * the callback of pseu_collect(). If the field has not been mapped yet, a
+ * new pseudonym is drawn, thus mapping a sorted list of fields assigns the
+ * pseudonyms in a deterministic order.
+ * @param type type of field
+ * @param key field
+ * @param len length of field
+ */
+void pseu_map(int type, uchar_t * key, ushort_t len)
+{
+   uchar_t tmp[BSM_TOKEN_MAX];
+
+   if (len > sizeof(tmp))
+      return;
+
+   /*
+    * The mapping functions replace the field by its pseudonym.
+    */
+   memcpy(tmp, key, len);
+
+   switch (type) {
+   case FIELD_UID:
+      pseu_uid(tmp);
+      break;
+   case FIELD_GID:
+      pseu_gid(tmp);
+      break;
+   case FIELD_PID:
+      pseu_pid(tmp);
+      break;
+   case FIELD_ADDR:
+      pseu_addr(tmp, &len);
+      break;
+   case FIELD_PATH:
+      pseu_path(tmp);
       break;
    }
 }
@@ -625,21 +1191,75 @@ void pseu_args(uchar_t * buf)
 /**
  * Read token from stream, pseudonymize the token and write it the output
  * stream. Tokens that contain data to be pseudonymized are passed to the
- * corresponding functions and are then written the output streams.
+ * corresponding functions and are then written the output streams. Chunks
+ * continuing an exec argument or environment token only hold strings.
+ * If token types are dropped, each record is assembled from its header to
+ * its trailer, so that its byte count can be patched. With
+ * resynchronization records are assembled as well, so that records cut
+ * off by corrupt data are dropped.
  * @param in input stream
- * @param zout compressed output stram
  * @param out output stream
  * @return 1 on success or 0 on failure.
  */
-int pseu_token(gzFile * in, gzFile * zout, FILE * out)
+int pseu_token(bsm_stream_t * in, bsm_out_t * out)
 {
-   uchar_t buf[BUFFER_SEG_SIZE];
+   uchar_t buf[BSM_TOKEN_MAX];
    int len;
 
-   len = BUFFER_SEG_SIZE;
+   len = BSM_TOKEN_MAX;
    if (!bsm_read(in, buf, &len))
       return 0;
 
+   if (!len)
+      return 1;
+
+   if (in->chunk & BSM_CHUNK_CONT) {
+      if (out->dropping) {
+	 out->dropping = in->chunk & BSM_CHUNK_MORE;
+	 return 1;
+      }
+      if (out->cols)
+	 return 1;
+      if (pseudonymize_args)
+	 kern_blank(buf, len);
+      if (out->emit)
+	 return emit_token(out, buf, len, in->chunk);
+      return bsm_write(out, buf, len);
+   }
+
+   if (retire_pids)
+      pseu_retire(buf);
+
+   if (drop_types[buf[0]]) {
+      out->dropping = in->chunk & BSM_CHUNK_MORE;
+      return 1;
+   }
+
+   /*
+    * Formatted records carry no byte counts to be patched. Partitioned
+    * records are routed as a whole. Records only assembled to drop them
+    * if they are cut off may be written early, so that large records are
+    * not held in memory. A file token ends a record that is still open,
+    * i.e. one cut off at the end of the previous file.
+    */
+   if ((drop_any || out->part || resync) && !out->emit && !out->cols) {
+      switch (buf[0]) {
+      case AUT_HEADER32:
+      case AUT_HEADER32_EX:
+      case AUT_HEADER64:
+      case AUT_HEADER64_EX:
+	 if (!bsm_begin(out))
+	    return 0;
+	 out->rec_stream = !drop_any && !out->part;
+	 break;
+      case AUT_OTHER_FILE32:
+      case AUT_OTHER_FILE64:
+	 if (!bsm_abort(out))
+	    return 0;
+	 break;
+      }
+   }
+
    if (pseudonymize_uids || pseudonymize_gids || pseudonymize_pids)
       pseu_ids(buf);
 
@@ -653,21 +1273,37 @@ int pseu_token(gzFile * in, gzFile * zout, FILE * out)
       pseu_times(buf);
 
    if (pseudonymize_args)
-      pseu_args(buf);
+      pseu_args(buf, len);
+
+   if (out->cols)
+      return cols_token(out->cols, buf, len);
+
+   if (out->emit)
+      return emit_token(out, buf, len, in->chunk);
+
+   if (out->part)
+      part_token(out->part, buf);
+
+   /*
+    * An assembled record is accounted when it is written, as it may still
+    * be dropped.
+    */
+   if (out->rot || out->idx) {
+      switch (buf[0]) {
+      case AUT_HEADER32:
+      case AUT_HEADER32_EX:
+      case AUT_HEADER64:
+      case AUT_HEADER64_EX:
+	 if (out->rec_open)
+	    out->rec_time = bsm_time(buf);
+	 else if (!bsm_account(out, bsm_time(buf)))
+	    return 0;
+	 break;
+      }
+   }
 
-   if (!bsm_write(zout, out, buf, len))
+   if (!bsm_write(out, buf, len))
       return 0;
 
-   byte_count += len;
-   if (byte_count >= 5000000) {
-      if (out)
-	 fflush(out);
-
-      if (zout)
-	 gzflush(zout, Z_SYNC_FLUSH);
-	 
-      byte_count = 0;
-   }
-
-   return 1;
+   return buf[0] == AUT_TRAILER ? bsm_end(out) : 1;
 }
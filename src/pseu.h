@@ -34,9 +34,31 @@
 #define PID_HASH_SIZE   32768		/**< Maximum number of pids */
 #define PATH_HASH_SIZE  131072		/**< Maximum number of paths */
 #define ADDR_HASH_SIZE  32768		/**< Maximum number of addresses */
+#define ESTIMATE_GROWTH 0.75		/**< Growth of distinct fields */
 
-int pseu_init(int, int, int, int, int, int, char **, long);
+#define FIELD_UID       0		/**< Field holding a uid */
+#define FIELD_GID       1		/**< Field holding a gid */
+#define FIELD_PID       2		/**< Field holding a pid */
+#define FIELD_ADDR      3		/**< Field holding an inet address */
+#define FIELD_PATH      4		/**< Field holding a pathname */
+#define FIELDS          5		/**< Number of field types */
+
+/**
+ * Callback for fields that are subject to pseudonymization. The key is
+ * the data that is mapped to a pseudonym.
+ */
+typedef void (*pseu_fn_field_t) (int type, uchar_t * key, ushort_t len,
+				 void *arg);
+
+int pseu_init(int, int, int, int, int, int, char **, long,
+	      unsigned long long);
+int pseu_drop(char *);
+void pseu_collect(uchar_t *, pseu_fn_field_t, void *);
+long pseu_estimate(bsm_stream_t *, long);
+int pseu_resize(unsigned long *);
+int pseu_presize(double);
+void pseu_map(int, uchar_t *, ushort_t);
 void pseu_deinit();
-int pseu_token(gzFile *, gzFile *, FILE *);
+int pseu_token(bsm_stream_t *, bsm_out_t *);
 
 #endif /* _PSEU_H */
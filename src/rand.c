@@ -25,6 +25,12 @@
  * identifier has its own random function so that special conditions can be
  * added separatly.
  *
+ * All functions draw from a generator context instead of the global state
+ * of lrand48(), so that runs can be reproduced from a seed. The generator
+ * is xoshiro256** running in RAND_LANES independent lanes. The lanes are
+ * advanced together in a loop the compiler can vectorize, which makes bulk
+ * generation of random bytes cheap.
+ *
  * @author Konrad Rieck
  * @version $Id: rand.c,v 3.1 2003/02/27 17:11:32 kr Exp $
  */
@@ -38,63 +44,174 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "rand.h"
 #include "config.h"
 
+#define ROTL(x, b)  (((x) << (b)) | ((x) >> (64 - (b))))
+
+/**
+ * Advance the state of a splitmix64 generator. The generator is only used
+ * to expand a seed into the state of the lanes.
+ * @param x state
+ * @return random value
+ */
+static unsigned long long rand_splitmix(unsigned long long *x)
+{
+   unsigned long long z;
+
+   z = (*x += 0x9e3779b97f4a7c15ULL);
+   z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+   return z ^ (z >> 31);
+}
+
+/**
+ * Seed a generator. Equal seeds yield equal sequences.
+ * @param r generator
+ * @param seed seed
+ */
+void rand_seed(rand_t * r, unsigned long long seed)
+{
+   int i, l;
+
+   for (l = 0; l < RAND_LANES; l++)
+      for (i = 0; i < 4; i++)
+	 r->s[i][l] = rand_splitmix(&seed);
+
+   r->pos = RAND_LANES;
+}
+
+/**
+ * Advance all lanes by one step and store their outputs.
+ * @param r generator
+ */
+static void rand_step(rand_t * r)
+{
+   unsigned long long t;
+   int l;
+
+   for (l = 0; l < RAND_LANES; l++) {
+      r->out[l] = ROTL(r->s[1][l] * 5, 7) * 9;
+      t = r->s[1][l] << 17;
+      r->s[2][l] ^= r->s[0][l];
+      r->s[3][l] ^= r->s[1][l];
+      r->s[1][l] ^= r->s[2][l];
+      r->s[0][l] ^= r->s[3][l];
+      r->s[2][l] ^= t;
+      r->s[3][l] = ROTL(r->s[3][l], 45);
+   }
+
+   r->pos = 0;
+}
+
+/**
+ * Draw a random 64 bit value.
+ * @param r generator
+ * @return random value
+ */
+unsigned long long rand_next(rand_t * r)
+{
+   if (r->pos == RAND_LANES)
+      rand_step(r);
+
+   return r->out[r->pos++];
+}
+
+/**
+ * Fill a buffer with random bytes.
+ * @param r generator
+ * @param buf buffer
+ * @param n number of bytes
+ */
+void rand_fill(rand_t * r, uchar_t * buf, int n)
+{
+   unsigned long long v;
+   int i;
+
+   /*
+    * Whole steps are copied and marked as consumed.
+    */
+   while (n >= sizeof(r->out)) {
+      rand_step(r);
+      memcpy(buf, r->out, sizeof(r->out));
+      r->pos = RAND_LANES;
+      buf += sizeof(r->out);
+      n -= sizeof(r->out);
+   }
+
+   while (n > 0) {
+      v = rand_next(r);
+      for (i = 0; i < 8 && n > 0; i++, n--)
+	 *buf++ = v >> (8 * i);
+   }
+}
+
 /**
  * Create a random uid within the given interval.
+ * @param r generator
  * @param min minimum uid
  * @param max maximum uid
  * @return uid between min and max
  */
-uid_t uid_rand(uid_t min, uid_t max)
+uid_t uid_rand(rand_t * r, uid_t min, uid_t max)
 {
-   return (uid_t) lrand48() % (max - min) + min;
+   return (uid_t) (rand_next(r) % (max - min)) + min;
 }
 
 /**
  * Create a random gid within the given interval.
+ * @param r generator
  * @param min minimum gid
  * @param max maximum gid
  * @return gid between min and max
  */
-gid_t gid_rand(gid_t min, gid_t max)
+gid_t gid_rand(rand_t * r, gid_t min, gid_t max)
 {
-   return (gid_t) lrand48() % (max - min) + min;
+   return (gid_t) (rand_next(r) % (max - min)) + min;
 }
 
 /*
  * Create a random pid within the given interval.
+ * @param r generator
  * @param min minimum pid
  * @param max maximum pid
  * @return pid between min and max
  */
-pid_t pid_rand(pid_t min, pid_t max)
+pid_t pid_rand(rand_t * r, pid_t min, pid_t max)
 {
-   return (pid_t) lrand48() % (max - min) + min;
+   return (pid_t) (rand_next(r) % (max - min)) + min;
 }
 
 /**
  * Create a random string at the location provided by the given pointer of n
- * length excluding the terminating NULL char.
+ * length excluding the terminating NULL char. Each character consumes two
+ * random bytes, one choosing between a slash, an upper and a lower case
+ * letter, one choosing the letter. The bytes are generated in bulk.
+ * @param r generator
  * @param str string to randomize
  * @param n length of character to modify
  * @return randomized string
  */
-char *str_rand(char *str, int n)
+char *str_rand(rand_t * r, char *str, int n)
 {
-   int i;
-   double d;
-   uchar_t c;
+   uchar_t buf[2 * RAND_CHUNK], d, c;
+   int i, j;
 
    for (i = 0; i < n; i++) {
-      d = drand48();
+      j = i % RAND_CHUNK;
+      if (j == 0)
+	 rand_fill(r, buf, 2 * (n - i < RAND_CHUNK ? n - i : RAND_CHUNK));
 
-      if (d > 0.80 && i != 0 && i < (n - 2) && str[i - 1] != '/')
+      /*
+       * Thresholds of 205 and 90 out of 256 correspond to 80% and 35%.
+       */
+      d = buf[2 * j];
+      if (d >= 205 && i != 0 && i < (n - 2) && str[i - 1] != '/')
 	 c = '/';
-      else if (d > 0.35 && str[i - 1] < 'Z')
-	 c = lrand48() % ('Z' - 'A') + 'A';
+      else if (d >= 90 && str[i - 1] < 'Z')
+	 c = buf[2 * j + 1] % ('Z' - 'A') + 'A';
       else
-	 c = lrand48() % ('z' - 'a') + 'a';
+	 c = buf[2 * j + 1] % ('z' - 'a') + 'a';
       str[i] = c;
    }
 
@@ -103,24 +220,19 @@ char *str_rand(char *str, int n)
 
 /**
  * Create a random inet address for either IPv4 or IPv6. Keep an eye on
- * the first and last byte and avoid using broadcast IPs, etc...
+ * the first and last byte and avoid using broadcast IPs, etc... The first
+ * byte is drawn from 60 to 200 and the last byte from 1 to 254.
+ * @param r generator
  * @param len size of addr
  * @param addr buffer with address
  * @return randomized inet address
  */
-uchar_t *addr_rand(int len, uchar_t * addr)
+uchar_t *addr_rand(rand_t * r, int len, uchar_t * addr)
 {
-   int i;
-   uchar_t c;
+   rand_fill(r, addr, len);
 
-   for (i = 0; i < len; i++) {
-      c = lrand48();
-      if ((i == 0 && (c > 200 || c < 60)) ||
-	  (i == len - 1 && (c == 255 || c == 0)))
-	 i--;
-      else
-	 addr[i] = c;
-   }
+   addr[0] = addr[0] % 141 + 60;
+   addr[len - 1] = addr[len - 1] % 254 + 1;
 
    return addr;
 }
@@ -29,10 +29,27 @@
 #ifndef _RAND_H
 #define _RAND_H
 
-uid_t uid_rand(uid_t min, uid_t max);
-pid_t pid_rand(pid_t min, pid_t max);
-gid_t gid_rand(gid_t min, gid_t max);
-uchar_t *addr_rand(int af, uchar_t * addr);
-char *str_rand(char *target, int n);
+#define RAND_LANES      4		/**< Number of generator lanes */
+#define RAND_CHUNK      128		/**< Characters generated in bulk */
+
+/**
+ * Random generator context. The state is stored lane by lane, so that the
+ * lanes can be advanced in parallel.
+ */
+typedef struct {
+   unsigned long long s[4][RAND_LANES];	  /**< State of the lanes */
+   unsigned long long out[RAND_LANES];	  /**< Outputs of the last step */
+   int pos;				  /**< Next unused output */
+} rand_t;
+
+void rand_seed(rand_t * r, unsigned long long seed);
+unsigned long long rand_next(rand_t * r);
+void rand_fill(rand_t * r, uchar_t * buf, int n);
+
+uid_t uid_rand(rand_t * r, uid_t min, uid_t max);
+pid_t pid_rand(rand_t * r, pid_t min, pid_t max);
+gid_t gid_rand(rand_t * r, gid_t min, gid_t max);
+uchar_t *addr_rand(rand_t * r, int af, uchar_t * addr);
+char *str_rand(rand_t * r, char *target, int n);
 
 #endif				/* _RAND_H */
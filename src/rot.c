@@ -0,0 +1,637 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file rot.c Rotated output.
+ * Instead of one stream, the pseudonymized records can be written to a
+ * sequence of files, so that they can be processed in parallel later on.
+ * A new file is started before a record if the current file has reached
+ * a given size or if the time of the record falls into a later period
+ * than the records of the current file. The names of the files are built
+ * from a template by strftime(3) using the time of the first record, and
+ * %N is replaced by the sequence number of the file.
+ *
+ * Like audit trails written by auditd(1M), each file ends with a file
+ * token naming its successor and starts with a file token naming its
+ * predecessor. A rotated file is finished, i.e. flushed, compressed,
+ * synced and indexed, by a thread of its own, while the records are
+ * already written to the next file. Without compression the thread also
+ * preallocates a spare file that is renamed to the name of the next file
+ * on rotation, so that no extent is allocated when the files switch.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "field.h"
+#include "bsm.h"
+#include "idx.h"
+#include "mout.h"
+#include "rot.h"
+#include "config.h"
+
+#define ROT_NAME_MAX      4096		/**< Maximum length of file names */
+
+extern int verbose;
+
+/**
+ * Finish a rotated file. The stream closes its descriptor, thus the file
+ * is synced through a duplicate of it afterwards. The job is not freed.
+ * @param j rotated file
+ * @return 1 on success or 0 on failure
+ */
+static int rot_finish(rot_job_t * j)
+{
+   int fd, ret = 1;
+
+   if ((fd = dup(j->out.fd)) < 0) {
+      err_msg("dup");
+      ret = 0;
+   }
+
+   if (!bsm_out_close(&j->out))
+      ret = 0;
+
+   if (fd >= 0) {
+      if (fsync(fd)) {
+	 err_msg("Could not sync %s", j->name);
+	 ret = 0;
+      }
+      close(fd);
+   }
+
+   if (verbose)
+      fprintf(stderr, "[rotate] %s: finished\n", j->name);
+
+   return ret;
+}
+
+/**
+ * Create and preallocate a spare file.
+ * @param name name of file
+ * @param size size of file
+ * @return file descriptor or -1 on failure
+ */
+static int rot_spare_create(char *name, long long size)
+{
+   int fd;
+
+   if ((fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+      return -1;
+
+   if (!mout_reserve(fd, 0, size)) {
+      close(fd);
+      unlink(name);
+      return -1;
+   }
+
+   return fd;
+}
+
+/**
+ * Thread finishing rotated files in the order of their rotation until the
+ * rotated output is closed. A requested spare file is preallocated first,
+ * as it is needed by the next rotation.
+ * @param arg rotated output
+ * @return NULL
+ */
+static void *rot_thread(void *arg)
+{
+   rot_t *r = arg;
+   rot_job_t *j;
+   long long size;
+   int ok, fd;
+
+   pthread_mutex_lock(&r->lock);
+   for (;;) {
+      while (!r->jobs && !r->prepare && !r->stop)
+	 pthread_cond_wait(&r->cond, &r->lock);
+
+      if (r->prepare && !r->stop) {
+	 r->prepare = 0;
+	 size = r->spare_size;
+	 pthread_mutex_unlock(&r->lock);
+	 fd = rot_spare_create(r->spare_name, size);
+	 pthread_mutex_lock(&r->lock);
+	 r->spare = fd;
+	 continue;
+      }
+
+      if (!(j = r->jobs))
+	 break;
+
+      pthread_mutex_unlock(&r->lock);
+      ok = rot_finish(j);
+      pthread_mutex_lock(&r->lock);
+
+      /*
+       * A file stays queued until it is finished, so that its name is
+       * not reused meanwhile.
+       */
+      r->jobs = j->next;
+      if (!r->jobs)
+	 r->last = NULL;
+      if (!ok)
+	 r->failed = 1;
+
+      free(j->name);
+      free(j);
+   }
+   pthread_mutex_unlock(&r->lock);
+
+   return NULL;
+}
+
+/**
+ * Detach the current file from an output stream. The stream is left
+ * without file and the file is wrapped for the finalizing thread.
+ * @param o output stream
+ * @return rotated file or NULL on failure
+ */
+static rot_job_t *rot_detach(bsm_out_t * o)
+{
+   rot_job_t *j;
+
+   if (!(j = malloc(sizeof(rot_job_t)))) {
+      err_msg("Failed to allocate memory");
+      return NULL;
+   }
+
+   /*
+    * An assembled record belongs to the next file.
+    */
+   j->out = *o;
+   j->out.rec = NULL;
+   j->out.rec_len = j->out.rec_size = 0;
+   j->out.rec_open = 0;
+   j->out.rot = NULL;
+   j->name = o->rot->name;
+   j->next = NULL;
+
+   o->fd = -1;
+   o->zout = NULL;
+   o->out = NULL;
+   o->mout = NULL;
+   o->idx = NULL;
+   o->rot->name = NULL;
+   return j;
+}
+
+/**
+ * Queue a rotated file for the finalizing thread.
+ * @param r rotated output
+ * @param j rotated file
+ * @return 1 on success or 0 if finalizing has failed before
+ */
+static int rot_enqueue(rot_t * r, rot_job_t * j)
+{
+   int failed;
+
+   pthread_mutex_lock(&r->lock);
+   if (r->last)
+      r->last->next = j;
+   else
+      r->jobs = j;
+   r->last = j;
+   failed = r->failed;
+   pthread_cond_broadcast(&r->cond);
+   pthread_mutex_unlock(&r->lock);
+
+   return !failed;
+}
+
+/**
+ * Request a spare file for the next rotation. Its size is the size limit
+ * of the files or the size of the previous file plus one window.
+ * @param r rotated output
+ * @param name name of the current file
+ * @param last size of the previous file
+ */
+static void rot_prepare(rot_t * r, char *name, long long last)
+{
+   if (r->compress)
+      return;
+
+   if (!r->spare_name) {
+      if (!(r->spare_name = malloc(strlen(name) + 6)))
+	 return;
+      sprintf(r->spare_name, "%s.next", name);
+   }
+
+   pthread_mutex_lock(&r->lock);
+   if (r->spare < 0) {
+      r->spare_size = ((r->size ? r->size : last) / MOUT_WINDOW + 1) *
+	  MOUT_WINDOW;
+      r->prepare = 1;
+      pthread_cond_broadcast(&r->cond);
+   }
+   pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * Take the spare file for the next file of a rotated output. The spare
+ * file is renamed, which fails if the name is on another file system.
+ * @param r rotated output
+ * @param name name of the next file
+ * @return file descriptor or -1 if no spare file is ready
+ */
+static int rot_spare(rot_t * r, char *name)
+{
+   int fd;
+
+   pthread_mutex_lock(&r->lock);
+   fd = r->spare;
+   r->spare = -1;
+   pthread_mutex_unlock(&r->lock);
+
+   if (fd >= 0 && rename(r->spare_name, name)) {
+      close(fd);
+      unlink(r->spare_name);
+      fd = -1;
+   }
+
+   return fd;
+}
+
+/**
+ * Check if a name belongs to the current file or to a file that is not
+ * finished yet.
+ * @param r rotated output
+ * @param name name of file
+ * @return 1 if the file is in use or 0 otherwise
+ */
+static int rot_used(rot_t * r, char *name)
+{
+   rot_job_t *j;
+   int used;
+
+   if (r->name && !strcmp(r->name, name))
+      return 1;
+
+   pthread_mutex_lock(&r->lock);
+   for (j = r->jobs; j && strcmp(j->name, name); j = j->next);
+   used = j != NULL;
+   pthread_mutex_unlock(&r->lock);
+
+   return used;
+}
+
+/**
+ * Build the name of a file from a template. With rotation, the sequence
+ * number is appended if the template does not contain it.
+ * @param r rotated output
+ * @param tmpl template
+ * @param time time of first record
+ * @return name or NULL on failure
+ */
+static char *rot_name(rot_t * r, char *tmpl, uint64_t time)
+{
+   char fmt[ROT_NAME_MAX], name[ROT_NAME_MAX];
+   struct tm tm;
+   time_t t = time;
+   int i, n = 0, seq = 0;
+
+   for (i = 0; tmpl[i] && n < ROT_NAME_MAX - 16; i++) {
+      if (tmpl[i] == '%' && tmpl[i + 1] == 'N') {
+	 n += sprintf(fmt + n, "%u", r->seq);
+	 seq = 1;
+	 i++;
+      } else if (tmpl[i] == '%' && tmpl[i + 1] == '%') {
+	 fmt[n++] = tmpl[i++];
+	 fmt[n++] = tmpl[i];
+      } else
+	 fmt[n++] = tmpl[i];
+   }
+
+   if (!seq && (r->size || r->interval))
+      n += sprintf(fmt + n, ".%u", r->seq);
+   fmt[n] = 0;
+
+   localtime_r(&t, &tm);
+   if (tmpl[i] || !strftime(name, ROT_NAME_MAX, fmt, &tm)) {
+      err_msg("Invalid file name template %s", tmpl);
+      return NULL;
+   }
+
+   return strdup(name);
+}
+
+/**
+ * Write a file token naming another file of the sequence.
+ * @param o output stream
+ * @param time time of token
+ * @param name name of other file
+ * @return 1 on success or 0 on failure
+ */
+static int rot_file_token(bsm_out_t * o, uint64_t time, char *name)
+{
+   uchar_t buf[11 + ROT_NAME_MAX];
+   int len = strlen(name) + 1;
+
+   buf[0] = AUT_OTHER_FILE32;
+   field_put32(buf + 1, time);
+   field_put32(buf + 5, 0);
+   field_put16(buf + 9, len);
+   memcpy(buf + 11, name, len);
+
+   return bsm_put(o, (char *) buf, 11 + len);
+}
+
+/**
+ * Start the next file of a rotated output. The current file is closed by
+ * a file token and queued for the finalizing thread.
+ * @param o output stream
+ * @param time time of first record of the next file
+ * @return 1 on success or 0 on failure
+ */
+static int rot_switch(bsm_out_t * o, uint64_t time)
+{
+   rot_t *r = o->rot;
+   rot_job_t *j = NULL;
+   char *name, *iname;
+   int fd, spare, ret = 0;
+
+   if (!(name = rot_name(r, r->output, time)))
+      return 0;
+
+   /*
+    * Opening the file would truncate records not yet finished.
+    */
+   if (rot_used(r, name)) {
+      err_msg("Output file %s is still in use", name);
+      free(name);
+      return 0;
+   }
+
+   if (r->name) {
+      if (!rot_file_token(o, time, name) || !(j = rot_detach(o))) {
+	 free(name);
+	 return 0;
+      }
+   }
+
+   spare = (fd = rot_spare(r, name)) >= 0;
+   if (!spare && (fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+      err_msg("Could not open %s", name);
+      free(name);
+      goto out;
+   }
+
+   /*
+    * A spare file not written through a mapping drops its preallocation.
+    */
+   if (!bsm_out_file(o, fd, r->compress ? OUT_ZLIB : OUT_MAP) ||
+       (spare && !o->mout && ftruncate(fd, 0))) {
+      err_msg("Could not open %s", name);
+      close(fd);
+      free(name);
+      goto out;
+   }
+   r->name = name;
+
+   if (verbose)
+      fprintf(stderr, "[rotate] %s: started\n", name);
+
+   if (r->index) {
+      if (!(iname = rot_name(r, r->index, time)))
+	 goto out;
+      o->idx = idx_open(o, iname);
+      free(iname);
+      if (!o->idx)
+	 goto out;
+   }
+
+   if (j && !rot_file_token(o, time, j->name))
+      goto out;
+
+   r->period = r->interval ? time / r->interval : 0;
+   r->seq++;
+   rot_prepare(r, name, j ? j->out.offset : 0);
+   ret = 1;
+
+ out:
+   if (j && !rot_enqueue(r, j))
+      ret = 0;
+   return ret;
+}
+
+/**
+ * Parse the limit of a rotated output. Sizes carry the suffix K, M or G,
+ * periods of time the suffix s, m, h or d. A number without suffix is a
+ * size in bytes.
+ * @param r rotated output
+ * @param limit limit to parse
+ * @return 1 on success or 0 on failure
+ */
+static int rot_limit(rot_t * r, char *limit)
+{
+   unsigned long long n;
+   char *end;
+
+   n = strtoull(limit, &end, 10);
+   if (end == limit || n == 0 || (*end && end[1]))
+      goto err;
+
+   switch (*end) {
+   case 0:
+      r->size = n;
+      break;
+   case 'K':
+      r->size = n << 10;
+      break;
+   case 'M':
+      r->size = n << 20;
+      break;
+   case 'G':
+      r->size = n << 30;
+      break;
+   case 's':
+      r->interval = n;
+      break;
+   case 'm':
+      r->interval = n * 60;
+      break;
+   case 'h':
+      r->interval = n * 3600;
+      break;
+   case 'd':
+      r->interval = n * 86400;
+      break;
+   default:
+      goto err;
+   }
+
+   return 1;
+
+ err:
+   err_msg("Invalid rotation limit %s", limit);
+   return 0;
+}
+
+/**
+ * Open a rotated output. The files are opened when the first data is
+ * written, so that their names can be built from the time of the data.
+ * @param output template of output files
+ * @param index template of index files or NULL
+ * @param limit size or period of files or NULL
+ * @param compress compress output files using zlib
+ * @return rotated output or NULL on failure
+ */
+rot_t *rot_open(char *output, char *index, char *limit, int compress)
+{
+   rot_t *r;
+
+   if (!(r = calloc(1, sizeof(rot_t)))) {
+      err_msg("Failed to allocate memory");
+      return NULL;
+   }
+
+   r->output = output;
+   r->index = index;
+   r->compress = compress;
+   r->spare = -1;
+
+   if (limit && !rot_limit(r, limit)) {
+      free(r);
+      return NULL;
+   }
+
+   pthread_mutex_init(&r->lock, NULL);
+   pthread_cond_init(&r->cond, NULL);
+   if (pthread_create(&r->thread, NULL, rot_thread, r)) {
+      err_msg("Could not create thread");
+      pthread_mutex_destroy(&r->lock);
+      pthread_cond_destroy(&r->cond);
+      free(r);
+      return NULL;
+   }
+
+   return r;
+}
+
+/**
+ * Account a record that is about to be written. If the record starts a
+ * new file, the current file is rotated.
+ * @param o output stream
+ * @param time pseudonymized time of the record
+ * @return 1 on success or 0 on failure
+ */
+int rot_record(bsm_out_t * o, uint64_t time)
+{
+   rot_t *r = o->rot;
+
+   if (!r->name)
+      return rot_switch(o, time);
+
+   if (r->size && o->offset >= r->size)
+      return rot_switch(o, time);
+
+   /*
+    * Records slightly out of order don't return to an earlier period.
+    */
+   if (r->interval && time / r->interval > r->period)
+      return rot_switch(o, time);
+
+   return 1;
+}
+
+/**
+ * Open the first file of a rotated output for data written before the
+ * first record, usually the file token of the input.
+ * @param o output stream
+ * @param buf data to be written
+ * @return 1 on success or 0 on failure
+ */
+int rot_first(bsm_out_t * o, uchar_t * buf)
+{
+   uint64_t t;
+
+   switch (buf[0]) {
+   case AUT_OTHER_FILE32:
+      t = field_get32(buf + 1);
+      break;
+   case AUT_OTHER_FILE64:
+      t = field_get64(buf + 1);
+      break;
+   case AUT_HEADER32:
+   case AUT_HEADER32_EX:
+   case AUT_HEADER64:
+   case AUT_HEADER64_EX:
+      t = bsm_time(buf);
+      break;
+   default:
+      t = time(NULL);
+   }
+
+   return rot_switch(o, t);
+}
+
+/**
+ * Close a rotated output. The current file is finished and the call waits
+ * until the finalizing thread has finished all files.
+ * @param o output stream
+ * @return 1 on success or 0 on failure
+ */
+int rot_close(bsm_out_t * o)
+{
+   rot_t *r = o->rot;
+   rot_job_t *j;
+   int ret = 1;
+
+   if (r->name && (!(j = rot_detach(o)) || !rot_enqueue(r, j)))
+      ret = 0;
+
+   pthread_mutex_lock(&r->lock);
+   r->stop = 1;
+   pthread_cond_broadcast(&r->cond);
+   pthread_mutex_unlock(&r->lock);
+   pthread_join(r->thread, NULL);
+
+   if (r->failed)
+      ret = 0;
+
+   if (r->spare >= 0) {
+      close(r->spare);
+      unlink(r->spare_name);
+   }
+   free(r->spare_name);
+
+   pthread_mutex_destroy(&r->lock);
+   pthread_cond_destroy(&r->cond);
+   free(r->name);
+   free(r);
+   o->rot = NULL;
+   return ret;
+}
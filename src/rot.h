@@ -0,0 +1,75 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file rot.h Rotated output header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _ROT_H
+#define _ROT_H
+
+/**
+ * Output file that has been rotated away and waits to be finalized by the
+ * thread of the rotated output.
+ */
+typedef struct s_rot_job {
+   bsm_out_t out;		     /**< Output of the file */
+   char *name;			     /**< Name of the file */
+   struct s_rot_job *next;	     /**< Next file in queue */
+} rot_job_t;
+
+/**
+ * Rotated output. The records are written to a sequence of files whose
+ * names are derived from a template. A new file is started when the
+ * current one exceeds a size or when the records reach the next period
+ * of time.
+ */
+typedef struct s_rot {
+   char *output;		     /**< Template of output files */
+   char *index;			     /**< Template of index files or NULL */
+   int compress;		     /**< Compress output files */
+   long long size;		     /**< Maximum size of a file or 0 */
+   uint64_t interval;		     /**< Length of a period or 0 */
+   uint64_t period;		     /**< Period of current file */
+   unsigned int seq;		     /**< Sequence number of next file */
+   char *name;			     /**< Name of current file */
+   pthread_t thread;		     /**< Finalizing thread */
+   pthread_mutex_t lock;	     /**< Lock of queue */
+   pthread_cond_t cond;		     /**< Change of queue */
+   rot_job_t *jobs;		     /**< Files to be finalized */
+   rot_job_t *last;		     /**< Last file in queue */
+   char *spare_name;		     /**< Name of preallocated file or NULL */
+   long long spare_size;	     /**< Size to preallocate */
+   int spare;			     /**< Preallocated file or -1 */
+   int prepare;			     /**< A file has to be preallocated */
+   int stop;			     /**< Thread has to stop */
+   int failed;			     /**< Finalizing has failed */
+} rot_t;
+
+rot_t *rot_open(char *output, char *index, char *limit, int compress);
+int rot_record(bsm_out_t * o, uint64_t time);
+int rot_first(bsm_out_t * o, uchar_t * buf);
+int rot_close(bsm_out_t * o);
+
+#endif				/* _ROT_H */
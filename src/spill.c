@@ -0,0 +1,224 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file spill.c On-disk spill store.
+ * Mappings that are evicted from a memory-bounded table are spilled to
+ * this store and faulted back on the next hit. The store is a hash table
+ * in an unlinked temporary file: a sparse array of SPILL_SIZE bucket
+ * offsets is followed by the appended records. Each record links to the
+ * previous record of its bucket. Records are never removed, so a spilled
+ * key always maps to the same data.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "hash.h"
+#include "spill.h"
+#include "config.h"
+
+/**
+ * Header of a record in the store. The key and the data follow the header.
+ */
+typedef struct {
+   unsigned long long o_next;	/* Offset of next record in bucket */
+   unsigned int i_hash;		/* Hash value of key */
+   unsigned short i_key_size;	/* Size of key */
+   unsigned short i_data_size;	/* Size of data */
+} spill_rec_t;
+
+#define BUCKET_OFFSET(h)  ((off_t) ((h) % SPILL_SIZE) * \
+                           sizeof(unsigned long long))
+
+/**
+ * Compute the hash value of a key.
+ * @param i_key_size size of key
+ * @param p_key key
+ * @return hash value
+ */
+static unsigned int spill_hash(unsigned int i_key_size, void *p_key)
+{
+   hash_key_t key;
+
+   key.i_size = i_key_size;
+   key.p_key = p_key;
+
+   return hash_one_at_a_time_hash(&key);
+}
+
+/**
+ * Create a spill store in the given directory. The file is unlinked right
+ * after creation and vanishes when the store is finalized.
+ * @param dir directory for the store file
+ * @return store or NULL on failure
+ */
+spill_t *spill_create(char *dir)
+{
+   spill_t *p_spill;
+   char name[1024];
+
+   if (!(p_spill = malloc(sizeof(spill_t))))
+      return NULL;
+
+   if (!(p_spill->p_buf = malloc(SPILL_BUF_SIZE))) {
+      free(p_spill);
+      return NULL;
+   }
+
+   snprintf(name, sizeof(name), "%s/bsmpseu.XXXXXX", dir);
+   p_spill->fd = mkstemp(name);
+   if (p_spill->fd == -1) {
+      err_msg("Could not create spill file in %s", dir);
+      free(p_spill->p_buf);
+      free(p_spill);
+      return NULL;
+   }
+   unlink(name);
+
+   /*
+    * The bucket array is sparse, unused buckets do not occupy disk space.
+    */
+   p_spill->o_end = (off_t) SPILL_SIZE * sizeof(unsigned long long);
+   if (ftruncate(p_spill->fd, p_spill->o_end) == -1) {
+      err_msg("ftruncate");
+      spill_finalize(p_spill);
+      return NULL;
+   }
+   p_spill->i_items = 0;
+
+   return p_spill;
+}
+
+/**
+ * Store data for a key. The key must not already be present in the store.
+ * @param p_spill store
+ * @param i_key_size size of key
+ * @param p_key key
+ * @param i_data_size size of data
+ * @param p_data data
+ * @return 1 on success or 0 on failure
+ */
+int spill_put(spill_t * p_spill, unsigned int i_key_size, void *p_key,
+	      unsigned int i_data_size, void *p_data)
+{
+   spill_rec_t rec;
+   unsigned long long o_head;
+   off_t o_bucket;
+
+   if (sizeof(rec) + i_key_size + i_data_size > SPILL_BUF_SIZE)
+      return 0;
+
+   rec.i_hash = spill_hash(i_key_size, p_key);
+   rec.i_key_size = i_key_size;
+   rec.i_data_size = i_data_size;
+
+   o_bucket = BUCKET_OFFSET(rec.i_hash);
+   if (pread(p_spill->fd, &rec.o_next, sizeof(rec.o_next), o_bucket) !=
+       sizeof(rec.o_next))
+      goto err;
+
+   memcpy(p_spill->p_buf, &rec, sizeof(rec));
+   memcpy(p_spill->p_buf + sizeof(rec), p_key, i_key_size);
+   memcpy(p_spill->p_buf + sizeof(rec) + i_key_size, p_data, i_data_size);
+
+   if (pwrite(p_spill->fd, p_spill->p_buf,
+	      sizeof(rec) + i_key_size + i_data_size, p_spill->o_end) !=
+       sizeof(rec) + i_key_size + i_data_size)
+      goto err;
+
+   o_head = p_spill->o_end;
+   if (pwrite(p_spill->fd, &o_head, sizeof(o_head), o_bucket) !=
+       sizeof(o_head))
+      goto err;
+
+   p_spill->o_end += sizeof(rec) + i_key_size + i_data_size;
+   p_spill->i_items++;
+
+   return 1;
+
+ err:
+   err_msg("Could not write to spill file");
+   return 0;
+}
+
+/**
+ * Lookup the data of a key. The returned data resides in a buffer of the
+ * store and is only valid until the next call to a store function.
+ * @param p_spill store
+ * @param i_key_size size of key
+ * @param p_key key
+ * @param i_data_size returns the size of the data
+ * @return pointer to data or NULL if the key is not present
+ */
+void *spill_get(spill_t * p_spill, unsigned int i_key_size, void *p_key,
+		unsigned int *i_data_size)
+{
+   spill_rec_t rec;
+   unsigned long long o_rec;
+   unsigned int i_hash, len;
+
+   i_hash = spill_hash(i_key_size, p_key);
+   if (pread(p_spill->fd, &o_rec, sizeof(o_rec), BUCKET_OFFSET(i_hash)) !=
+       sizeof(o_rec))
+      return NULL;
+
+   for (; o_rec; o_rec = rec.o_next) {
+      if (pread(p_spill->fd, &rec, sizeof(rec), o_rec) != sizeof(rec))
+	 return NULL;
+
+      if (rec.i_hash != i_hash || rec.i_key_size != i_key_size)
+	 continue;
+
+      len = rec.i_key_size + rec.i_data_size;
+      if (pread(p_spill->fd, p_spill->p_buf, len, o_rec + sizeof(rec)) !=
+	  len)
+	 return NULL;
+
+      if (!memcmp(p_spill->p_buf, p_key, i_key_size)) {
+	 *i_data_size = rec.i_data_size;
+	 return p_spill->p_buf + i_key_size;
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * Close the store and free its memory.
+ * @param p_spill store
+ */
+void spill_finalize(spill_t * p_spill)
+{
+   if (!p_spill)
+      return;
+
+   close(p_spill->fd);
+   free(p_spill->p_buf);
+   free(p_spill);
+}
@@ -0,0 +1,53 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file spill.h On-disk spill store header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _SPILL_H
+#define _SPILL_H
+
+#define SPILL_SIZE      4194304		/**< Number of buckets on disk */
+#define SPILL_BUF_SIZE  131072		/**< Maximum size of key and data */
+
+/**
+ * Spill store. The store is a hash table kept in an unlinked temporary
+ * file. Only the file descriptor and a record buffer are kept in memory.
+ */
+typedef struct {
+   int fd;			     /**< Descriptor of the store file */
+   off_t o_end;			     /**< End of the store file */
+   unsigned int i_items;	     /**< Number of stored records */
+   unsigned char *p_buf;	     /**< Buffer for reading records */
+} spill_t;
+
+spill_t *spill_create(char *dir);
+int spill_put(spill_t * p_spill, unsigned int i_key_size, void *p_key,
+	      unsigned int i_data_size, void *p_data);
+void *spill_get(spill_t * p_spill, unsigned int i_key_size, void *p_key,
+		unsigned int *i_data_size);
+void spill_finalize(spill_t * p_spill);
+
+#endif				/* _SPILL_H */
@@ -0,0 +1,516 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file uring.c Asynchronous file I/O.
+ * On Linux, regular files can be read and written through io_uring, so
+ * that several large requests are in flight at any time. A reader keeps
+ * URING_DEPTH blocks queued ahead of the parser and hands out their data
+ * in order, a writer collects the output in blocks and queues each full
+ * block behind the pseudonymizer. The blocks are registered with the
+ * kernel if the limit of locked memory permits.
+ *
+ * Without io_uring, or if a ring can't be set up, no queue is created
+ * and the files are read by zlib and written by stdio as usual.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "uring.h"
+#include "config.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+/**
+ * Queue of asynchronous requests. Each block has a target length, i.e.
+ * the block size for reads and the collected output for writes, and the
+ * number of bytes transferred so far. A block is complete if all bytes
+ * have been transferred or a read has hit the end of the file.
+ */
+struct s_uring {
+   struct io_uring ring;	     /**< Submission and completion queue */
+   int fd;			     /**< File descriptor of file */
+   int writer;			     /**< Queue writes instead of reads */
+   int fixed;			     /**< Blocks are registered */
+   uchar_t *mem;		     /**< Memory of blocks */
+   struct iovec iov[URING_DEPTH];    /**< Blocks */
+   long long offs[URING_DEPTH];	     /**< File offsets of blocks */
+   int lens[URING_DEPTH];	     /**< Target lengths of blocks */
+   int xfer[URING_DEPTH];	     /**< Transferred bytes of blocks */
+   int eof[URING_DEPTH];	     /**< Read of block hit end of file */
+   int busy[URING_DEPTH];	     /**< Request of block in flight */
+   long long off;		     /**< File offset of next block */
+   int head;			     /**< Block read or filled next */
+   int pos;			     /**< Position in head block */
+   int failed;			     /**< A request has failed */
+};
+
+#define BLOCK_DONE(u, i)  ((u)->xfer[i] == (u)->lens[i] || (u)->eof[i])
+
+/**
+ * Queue the request for the rest of a block. The request is submitted by
+ * the caller.
+ * @param u queue
+ * @param i block
+ * @return 1 on success or 0 on failure
+ */
+static int uring_queue(uring_t * u, int i)
+{
+   struct io_uring_sqe *sqe;
+   uchar_t *buf = (uchar_t *) u->iov[i].iov_base + u->xfer[i];
+   int len = u->lens[i] - u->xfer[i];
+   long long off = u->offs[i] + u->xfer[i];
+
+   if (!(sqe = io_uring_get_sqe(&u->ring))) {
+      err_msg("io_uring: submission queue full");
+      return 0;
+   }
+
+   if (u->writer && u->fixed)
+      io_uring_prep_write_fixed(sqe, u->fd, buf, len, off, i);
+   else if (u->writer)
+      io_uring_prep_write(sqe, u->fd, buf, len, off);
+   else if (u->fixed)
+      io_uring_prep_read_fixed(sqe, u->fd, buf, len, off, i);
+   else
+      io_uring_prep_read(sqe, u->fd, buf, len, off);
+
+   io_uring_sqe_set_data(sqe, (void *) (intptr_t) i);
+   u->busy[i] = 1;
+   return 1;
+}
+
+/**
+ * Submit the queued requests.
+ * @param u queue
+ * @return 1 on success or 0 on failure
+ */
+static int uring_submit(uring_t * u)
+{
+   int ret;
+
+   if ((ret = io_uring_submit(&u->ring)) < 0) {
+      errno = -ret;
+      err_msg("io_uring_submit");
+      return 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Wait for the completion of a request and account its result.
+ * Interrupted requests are left incomplete and queued again later.
+ * @param u queue
+ * @return 1 on success or 0 on failure
+ */
+static int uring_reap(uring_t * u)
+{
+   struct io_uring_cqe *cqe;
+   int i, res, ret;
+
+   if ((ret = io_uring_wait_cqe(&u->ring, &cqe)) < 0) {
+      errno = -ret;
+      err_msg("io_uring_wait_cqe");
+      return 0;
+   }
+
+   i = (intptr_t) io_uring_cqe_get_data(cqe);
+   res = cqe->res;
+   io_uring_cqe_seen(&u->ring, cqe);
+   u->busy[i] = 0;
+
+   if (res == -EINTR || res == -EAGAIN)
+      return 1;
+
+   if (res < 0 || (res == 0 && u->writer)) {
+      errno = res < 0 ? -res : EIO;
+      err_msg("Could not %s file", u->writer ? "write" : "read");
+      u->failed = 1;
+      return 0;
+   }
+
+   if (res == 0)
+      u->eof[i] = 1;
+   u->xfer[i] += res;
+   return 1;
+}
+
+/**
+ * Wait until a block is complete. Short transfers are continued.
+ * @param u queue
+ * @param i block
+ * @return 1 on success or 0 on failure
+ */
+static int uring_complete(uring_t * u, int i)
+{
+   while (!BLOCK_DONE(u, i)) {
+      if (u->busy[i]) {
+	 if (!uring_reap(u))
+	    return 0;
+      } else if (!uring_queue(u, i) || !uring_submit(u))
+	 return 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Wait for all requests in flight.
+ * @param u queue
+ * @return 1 on success or 0 on failure
+ */
+static int uring_drain(uring_t * u)
+{
+   int i, ret = 1;
+
+   for (i = 0; i < URING_DEPTH; i++)
+      while (u->busy[i])
+	 if (!uring_reap(u))
+	    ret = 0;
+
+   return ret;
+}
+
+/**
+ * Create a queue for a file.
+ * @param fd file descriptor
+ * @param writer queue writes instead of reads
+ * @return queue or NULL if io_uring is not available
+ */
+static uring_t *uring_create(int fd, int writer)
+{
+   uring_t *u;
+   int i;
+
+   if (!(u = calloc(1, sizeof(uring_t))))
+      return NULL;
+
+   if (!(u->mem = malloc(URING_DEPTH * URING_BLOCK)))
+      goto err;
+
+   if (io_uring_queue_init(2 * URING_DEPTH, &u->ring, 0) < 0)
+      goto err;
+
+   for (i = 0; i < URING_DEPTH; i++) {
+      u->iov[i].iov_base = u->mem + i * URING_BLOCK;
+      u->iov[i].iov_len = URING_BLOCK;
+   }
+
+   /*
+    * Registered blocks count against the limit of locked memory. Without
+    * them, the kernel maps the blocks for each request.
+    */
+   u->fixed = !io_uring_register_buffers(&u->ring, u->iov, URING_DEPTH);
+   u->fd = fd;
+   u->writer = writer;
+   return u;
+
+ err:
+   free(u->mem);
+   free(u);
+   return NULL;
+}
+
+/**
+ * Queue the reads of all blocks, starting at a file offset.
+ * @param u queue
+ * @param offset file offset
+ * @return 1 on success or 0 on failure
+ */
+static int uring_start(uring_t * u, long long offset)
+{
+   int i;
+
+   for (i = 0; i < URING_DEPTH; i++) {
+      u->offs[i] = offset + (long long) i *URING_BLOCK;
+      u->lens[i] = URING_BLOCK;
+      u->xfer[i] = u->eof[i] = 0;
+      if (!uring_queue(u, i))
+	 return 0;
+   }
+
+   u->off = offset + (long long) URING_DEPTH *URING_BLOCK;
+   u->head = u->pos = 0;
+   return uring_submit(u);
+}
+
+/**
+ * Create a queue of reads for a regular file of at least URING_DEPTH
+ * blocks.
+ * @param fd file descriptor
+ * @param offset file offset of first read
+ * @return queue or NULL if the file can't be read through io_uring
+ */
+uring_t *uring_reader(int fd, long long offset)
+{
+   struct stat st;
+   uring_t *u;
+
+   /*
+    * Small files are read by a few requests anyway and don't pay off the
+    * setup of a ring.
+    */
+   if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+       st.st_size < URING_DEPTH * URING_BLOCK || !(u = uring_create(fd, 0)))
+      return NULL;
+
+   if (!uring_start(u, offset)) {
+      uring_close(u);
+      return NULL;
+   }
+
+   return u;
+}
+
+/**
+ * Read data from a queue of reads. Each drained block is queued again for
+ * the next block of the file.
+ * @param u queue
+ * @param buf buffer
+ * @param len number of bytes to read
+ * @return number of bytes read, less than len only at the end of the
+ * file, or -1 on failure
+ */
+int uring_read(uring_t * u, uchar_t * buf, int len)
+{
+   int i, n, total = 0;
+
+   while (total < len) {
+      i = u->head;
+      if (!uring_complete(u, i))
+	 return -1;
+
+      n = u->xfer[i] - u->pos;
+      if (n > len - total)
+	 n = len - total;
+
+      memcpy(buf + total, (uchar_t *) u->iov[i].iov_base + u->pos, n);
+      total += n;
+      u->pos += n;
+
+      if (u->pos < u->xfer[i])
+	 break;
+      if (u->eof[i])
+	 break;
+
+      u->offs[i] = u->off;
+      u->off += URING_BLOCK;
+      u->xfer[i] = 0;
+      if (!uring_queue(u, i) || !uring_submit(u))
+	 return -1;
+
+      u->head = (i + 1) % URING_DEPTH;
+      u->pos = 0;
+   }
+
+   return total;
+}
+
+/**
+ * Continue reading at another file offset. Reads in flight are discarded.
+ * @param u queue
+ * @param offset file offset
+ * @return 1 on success or 0 on failure
+ */
+int uring_seek(uring_t * u, long long offset)
+{
+   return uring_drain(u) && uring_start(u, offset);
+}
+
+/**
+ * Create a queue of writes for a regular file. Writing starts at the
+ * current position of the descriptor. Files opened for appending are
+ * written through stdio, as they ignore the offsets of writes, and so are
+ * files shared with the standard error, e.g. by 2>&1, as messages would
+ * be overwritten.
+ * @param fd file descriptor
+ * @return queue or NULL if the file can't be written through io_uring
+ */
+uring_t *uring_writer(int fd)
+{
+   struct stat st, err;
+   long long pos;
+   uring_t *u;
+
+   if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+       (fcntl(fd, F_GETFL) & O_APPEND) ||
+       (pos = lseek(fd, 0, SEEK_CUR)) < 0)
+      return NULL;
+
+   if (fd != 2 && !fstat(2, &err) && err.st_dev == st.st_dev &&
+       err.st_ino == st.st_ino)
+      return NULL;
+
+   if (!(u = uring_create(fd, 1)))
+      return NULL;
+
+   u->off = pos;
+   return u;
+}
+
+/**
+ * Queue the head block of a queue of writes and wait until the next block
+ * can be filled.
+ * @param u queue
+ * @return 1 on success or 0 on failure
+ */
+static int uring_flush(uring_t * u)
+{
+   int i = u->head;
+
+   u->offs[i] = u->off;
+   u->off += u->lens[i];
+   if (!uring_queue(u, i) || !uring_submit(u))
+      return 0;
+
+   u->head = i = (i + 1) % URING_DEPTH;
+   if (!uring_complete(u, i))
+      return 0;
+
+   u->lens[i] = u->xfer[i] = 0;
+   return 1;
+}
+
+/**
+ * Write data to a queue of writes.
+ * @param u queue
+ * @param buf data
+ * @param len length of data
+ * @return 1 on success or 0 on failure
+ */
+int uring_write(uring_t * u, char *buf, int len)
+{
+   int i, n;
+
+   while (len > 0) {
+      i = u->head;
+      n = URING_BLOCK - u->lens[i];
+      if (n > len)
+	 n = len;
+
+      memcpy((uchar_t *) u->iov[i].iov_base + u->lens[i], buf, n);
+      u->lens[i] += n;
+      buf += n;
+      len -= n;
+
+      if (u->lens[i] == URING_BLOCK && !uring_flush(u))
+	 return 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Close a queue. A queue of writes is flushed, the position of the file
+ * is set to the end of the written data and the descriptor is closed.
+ * @param u queue or NULL
+ * @return 1 on success or 0 on failure
+ */
+int uring_close(uring_t * u)
+{
+   int i, ret = 1;
+
+   if (!u)
+      return 1;
+
+   if (u->writer && !u->failed) {
+      if (u->lens[u->head] && !uring_flush(u))
+	 ret = 0;
+      for (i = 0; ret && i < URING_DEPTH; i++)
+	 if (!uring_complete(u, i))
+	    ret = 0;
+   }
+
+   if (!uring_drain(u) || u->failed)
+      ret = 0;
+
+   io_uring_queue_exit(&u->ring);
+
+   if (u->writer) {
+      if (lseek(u->fd, u->off, SEEK_SET) < 0) {
+	 err_msg("lseek");
+	 ret = 0;
+      }
+      if (close(u->fd)) {
+	 err_msg("close");
+	 ret = 0;
+      }
+   }
+
+   free(u->mem);
+   free(u);
+   return ret;
+}
+
+#else
+
+/*
+ * Without io_uring no queues are created, thus only the constructors and
+ * uring_close() are ever called.
+ */
+
+uring_t *uring_reader(int fd, long long offset)
+{
+   return NULL;
+}
+
+int uring_read(uring_t * u, uchar_t * buf, int len)
+{
+   return -1;
+}
+
+int uring_seek(uring_t * u, long long offset)
+{
+   return 0;
+}
+
+uring_t *uring_writer(int fd)
+{
+   return NULL;
+}
+
+int uring_write(uring_t * u, char *buf, int len)
+{
+   return 0;
+}
+
+int uring_close(uring_t * u)
+{
+   return 1;
+}
+
+#endif
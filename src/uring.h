@@ -0,0 +1,48 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file uring.h Asynchronous file I/O header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _URING_H
+#define _URING_H
+
+#define URING_DEPTH       4		/**< Number of queued blocks */
+#define URING_BLOCK       (1 << 20)	/**< Size of a block */
+
+/**
+ * Queue of asynchronous reads or writes of a file. The structure is only
+ * defined if io_uring is available and is therefore opaque.
+ */
+typedef struct s_uring uring_t;
+
+uring_t *uring_reader(int fd, long long offset);
+int uring_read(uring_t * u, uchar_t * buf, int len);
+int uring_seek(uring_t * u, long long offset);
+uring_t *uring_writer(int fd);
+int uring_write(uring_t * u, char *buf, int len);
+int uring_close(uring_t * u);
+
+#endif				/* _URING_H */
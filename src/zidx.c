@@ -0,0 +1,510 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file zidx.c Access point index for gzip files.
+ * Data in a gzip file can only be reached by decompressing everything
+ * before it. An index of access points, taken every ZIDX_SPAN bytes of
+ * uncompressed data at deflate block boundaries, allows to start
+ * decompressing near any offset. Each point stores the 32 kB window of
+ * uncompressed data preceding it, which back references may refer to.
+ *
+ * The index is built by decompressing the file once and is cached in a
+ * file next to it with the suffix ZIDX_SUFFIX. A cached index is reused as
+ * long as size and modification time of the gzip file match. If the index
+ * can't be cached, it is kept in a temporary file.
+ *
+ * The index file holds ZIDX_MAGIC, the size and modification time of the
+ * gzip file (8 bytes each), the span and the number of points (4 bytes
+ * each), followed by one entry per point with its uncompressed and
+ * compressed offset (8 bytes each), its bits (4 bytes) and its window.
+ * All numbers are in network byte order.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <bsm/audit.h>
+#include <bsm/audit_record.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "misc.h"
+#include "field.h"
+#include "zidx.h"
+#include "config.h"
+
+/**
+ * Add an access point to an index being built. The entry of the point is
+ * written to the index file at once.
+ * @param x index
+ * @param out offset in uncompressed data
+ * @param in offset in compressed file
+ * @param bits bits of previous byte
+ * @param win circular buffer of recent uncompressed data
+ * @param left free bytes at the end of the buffer
+ * @return 1 on success or 0 on failure
+ */
+static int zidx_point(zidx_t * x, uint64_t out, uint64_t in, int bits,
+		      uchar_t * win, unsigned int left)
+{
+   uchar_t e[ZIDX_ENTRY_SIZE];
+   zidx_point_t *p;
+
+   if (!(x->num & (x->num - 1))) {
+      p = realloc(x->points, sizeof(zidx_point_t) * (x->num ? 2 * x->num : 1));
+      if (!p) {
+	 err_msg("Failed to allocate memory");
+	 return 0;
+      }
+      x->points = p;
+   }
+
+   p = &x->points[x->num];
+   p->out = out;
+   p->in = in;
+   p->bits = bits;
+
+   /*
+    * The oldest data of the window follows the free bytes.
+    */
+   field_put64(e, out);
+   field_put64(e + 8, in);
+   field_put32(e + 16, bits);
+   memcpy(e + 20, win + ZIDX_WINDOW - left, left);
+   memcpy(e + 20 + left, win, ZIDX_WINDOW - left);
+
+   if (fseeko(x->fp, ZIDX_HEADER_SIZE + (off_t) x->num * ZIDX_ENTRY_SIZE,
+	      SEEK_SET) || fwrite(e, sizeof(e), 1, x->fp) != 1) {
+      err_msg("Could not write gzip index");
+      return 0;
+   }
+
+   x->num++;
+   return 1;
+}
+
+/**
+ * Build the index of a gzip file. The file is decompressed block by block
+ * and a point is added at the first block boundary after every ZIDX_SPAN
+ * bytes. Concatenated gzip members are decompressed one after another, a
+ * truncated file ends the index at the truncation.
+ * @param x index
+ * @param fd gzip file
+ * @return 1 on success or 0 on failure
+ */
+static int zidx_build(zidx_t * x, int fd)
+{
+   uchar_t in[ZIDX_CHUNK], win[ZIDX_WINDOW];
+   uint64_t totin = 0, totout = 0, last = 0, rpos = 0;
+   z_stream strm;
+   int ret, n;
+
+   memset(&strm, 0, sizeof(strm));
+   if (inflateInit2(&strm, 31) != Z_OK) {
+      err_msg("inflateInit2");
+      return 0;
+   }
+
+   for (;;) {
+      if (strm.avail_in == 0) {
+	 if ((n = pread(fd, in, sizeof(in), rpos)) <= 0)
+	    break;
+	 rpos += n;
+	 strm.next_in = in;
+	 strm.avail_in = n;
+      }
+
+      if (strm.avail_out == 0) {
+	 strm.next_out = win;
+	 strm.avail_out = sizeof(win);
+      }
+
+      totin += strm.avail_in;
+      totout += strm.avail_out;
+      ret = inflate(&strm, Z_BLOCK);
+      totin -= strm.avail_in;
+      totout -= strm.avail_out;
+
+      /*
+       * Another gzip member may follow the end of a member.
+       */
+      if (ret == Z_STREAM_END) {
+	 if (strm.avail_in == 0) {
+	    if ((n = pread(fd, in, sizeof(in), rpos)) <= 0)
+	       break;
+	    rpos += n;
+	    strm.next_in = in;
+	    strm.avail_in = n;
+	 }
+
+	 if (strm.next_in[0] != 0x1f)
+	    break;
+
+	 inflateReset(&strm);
+	 continue;
+      }
+
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+	 err_msg("Corrupt gzip data at %llu", (unsigned long long) totin);
+	 inflateEnd(&strm);
+	 return 0;
+      }
+
+      if ((strm.data_type & 128) && !(strm.data_type & 64) &&
+	  (totout == 0 || totout - last >= ZIDX_SPAN)) {
+	 if (!zidx_point(x, totout, totin, strm.data_type & 7, win,
+			 strm.avail_out)) {
+	    inflateEnd(&strm);
+	    return 0;
+	 }
+	 last = totout;
+      }
+   }
+
+   inflateEnd(&strm);
+   x->size = totout;
+   return 1;
+}
+
+/**
+ * Load a cached index. The header has to match the gzip file.
+ * @param x index
+ * @param st status of gzip file
+ * @return 1 on success or 0 if the index is stale or invalid
+ */
+static int zidx_load(zidx_t * x, struct stat *st)
+{
+   uchar_t h[ZIDX_HEADER_SIZE], e[20];
+   unsigned int i, num;
+
+   if (fread(h, sizeof(h), 1, x->fp) != 1 || memcmp(h, ZIDX_MAGIC, 8) ||
+       field_get64(h + 8) != st->st_size ||
+       field_get64(h + 16) != st->st_mtime ||
+       field_get32(h + 24) != ZIDX_SPAN)
+      return 0;
+
+   num = field_get32(h + 28);
+   x->size = field_get64(h + 32);
+   if (!(x->points = malloc(sizeof(zidx_point_t) * (num ? num : 1))))
+      return 0;
+
+   for (i = 0; i < num; i++) {
+      if (fseeko(x->fp, ZIDX_HEADER_SIZE + (off_t) i * ZIDX_ENTRY_SIZE,
+		 SEEK_SET) || fread(e, sizeof(e), 1, x->fp) != 1)
+	 return 0;
+
+      x->points[i].out = field_get64(e);
+      x->points[i].in = field_get64(e + 8);
+      x->points[i].bits = field_get32(e + 16);
+   }
+
+   x->num = num;
+   return 1;
+}
+
+/**
+ * Open the index of a gzip file. A cached index is loaded if it matches
+ * the file, otherwise the index is built and cached. The cache is only
+ * used if the name refers to the file.
+ * @param name name of gzip file
+ * @param fd gzip file
+ * @param build build the index if there is no cached one
+ * @return index or NULL on failure
+ */
+zidx_t *zidx_open(char *name, int fd, int build)
+{
+   uchar_t h[ZIDX_HEADER_SIZE];
+   struct stat st, nst;
+   char *path = NULL;
+   zidx_t *x;
+
+   if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+      return NULL;
+
+   if (!(x = calloc(1, sizeof(zidx_t)))) {
+      err_msg("Failed to allocate memory");
+      return NULL;
+   }
+
+   if (!stat(name, &nst) && nst.st_dev == st.st_dev &&
+       nst.st_ino == st.st_ino &&
+       (path = malloc(strlen(name) + strlen(ZIDX_SUFFIX) + 1))) {
+      sprintf(path, "%s%s", name, ZIDX_SUFFIX);
+
+      if ((x->fp = fopen(path, "rb"))) {
+	 if (zidx_load(x, &st)) {
+	    free(path);
+	    return x;
+	 }
+
+	 fclose(x->fp);
+	 free(x->points);
+	 x->points = NULL;
+      }
+      x->fp = build ? fopen(path, "w+b") : NULL;
+   }
+
+   if (!build) {
+      free(path);
+      free(x);
+      return NULL;
+   }
+
+   if (!x->fp && !(x->fp = tmpfile())) {
+      err_msg("Could not create gzip index for %s", name);
+      free(path);
+      free(x);
+      return NULL;
+   }
+
+   if (!zidx_build(x, fd)) {
+      if (path)
+	 unlink(path);
+      free(path);
+      zidx_close(x);
+      return NULL;
+   }
+
+   /*
+    * The header is written last, an incomplete index is never loaded.
+    */
+   memcpy(h, ZIDX_MAGIC, 8);
+   field_put64(h + 8, st.st_size);
+   field_put64(h + 16, st.st_mtime);
+   field_put32(h + 24, ZIDX_SPAN);
+   field_put32(h + 28, x->num);
+   field_put64(h + 32, x->size);
+
+   if (fseeko(x->fp, 0, SEEK_SET) || fwrite(h, sizeof(h), 1, x->fp) != 1 ||
+       fflush(x->fp)) {
+      err_msg("Could not write gzip index for %s", name);
+      if (path)
+	 unlink(path);
+      free(path);
+      zidx_close(x);
+      return NULL;
+   }
+
+   free(path);
+   return x;
+}
+
+/**
+ * Close an index.
+ * @param x index
+ */
+void zidx_close(zidx_t * x)
+{
+   if (!x)
+      return;
+
+   fclose(x->fp);
+   free(x->points);
+   free(x);
+}
+
+/**
+ * Read compressed data into the buffer of a reader.
+ * @param r reader
+ * @return number of bytes read, 0 at the end of the file or -1 on failure
+ */
+static int zidx_fill(zidx_reader_t * r)
+{
+   int n;
+
+   if ((n = pread(r->fd, r->buf, sizeof(r->buf), r->pos)) < 0) {
+      err_msg("Could not read gzip data");
+      return -1;
+   }
+
+   r->pos += n;
+   r->strm.next_in = r->buf;
+   r->strm.avail_in = n;
+   return n;
+}
+
+/**
+ * Open a reader at an offset of the uncompressed data. Decompression
+ * starts at the last point before the offset and the data up to the
+ * offset is discarded.
+ * @param x index
+ * @param fd gzip file
+ * @param offset offset in uncompressed data
+ * @return reader or NULL on failure
+ */
+zidx_reader_t *zidx_seek(zidx_t * x, int fd, uint64_t offset)
+{
+   uchar_t win[ZIDX_WINDOW], c;
+   unsigned int lo = 0, hi = x->num, mid;
+   zidx_point_t *p;
+   zidx_reader_t *r;
+   uint64_t skip;
+   int n;
+
+   if (!x->num || x->points[0].out > offset)
+      return NULL;
+
+   /*
+    * Binary search for the last point at or before the offset.
+    */
+   while (hi - lo > 1) {
+      mid = lo + (hi - lo) / 2;
+      if (x->points[mid].out <= offset)
+	 lo = mid;
+      else
+	 hi = mid;
+   }
+   p = &x->points[lo];
+
+   if (fseeko(x->fp, ZIDX_HEADER_SIZE + (off_t) lo * ZIDX_ENTRY_SIZE + 20,
+	      SEEK_SET) || fread(win, sizeof(win), 1, x->fp) != 1) {
+      err_msg("Could not read gzip index");
+      return NULL;
+   }
+
+   if (!(r = calloc(1, sizeof(zidx_reader_t)))) {
+      err_msg("Failed to allocate memory");
+      return NULL;
+   }
+
+   r->fd = fd;
+   r->pos = p->in;
+   r->raw = 1;
+
+   if (inflateInit2(&r->strm, -15) != Z_OK) {
+      free(r);
+      return NULL;
+   }
+
+   if (p->bits) {
+      if (pread(fd, &c, 1, p->in - 1) != 1) {
+	 zidx_end(r);
+	 return NULL;
+      }
+      inflatePrime(&r->strm, p->bits, c >> (8 - p->bits));
+   }
+   inflateSetDictionary(&r->strm, win, sizeof(win));
+
+   for (skip = offset - p->out; skip > 0; skip -= n) {
+      n = zidx_read(r, win, skip < sizeof(win) ? skip : sizeof(win));
+      if (n <= 0) {
+	 zidx_end(r);
+	 return NULL;
+      }
+   }
+
+   return r;
+}
+
+/**
+ * Skip compressed bytes, e.g. the trailer of a gzip member.
+ * @param r reader
+ * @param n number of bytes
+ * @return 1 on success or 0 at the end of the file
+ */
+static int zidx_skip(zidx_reader_t * r, unsigned int n)
+{
+   unsigned int k;
+
+   while (n > 0) {
+      if (r->strm.avail_in == 0 && zidx_fill(r) <= 0)
+	 return 0;
+
+      k = n < r->strm.avail_in ? n : r->strm.avail_in;
+      r->strm.next_in += k;
+      r->strm.avail_in -= k;
+      n -= k;
+   }
+
+   return 1;
+}
+
+/**
+ * Read uncompressed data from a reader. A read is only short at the end
+ * of the data.
+ * @param r reader
+ * @param buf buffer
+ * @param len length of buffer
+ * @return number of bytes read or -1 on failure
+ */
+int zidx_read(zidx_reader_t * r, uchar_t * buf, int len)
+{
+   int ret, n;
+
+   r->strm.next_out = buf;
+   r->strm.avail_out = len;
+
+   while (r->strm.avail_out > 0 && !r->eof) {
+      if (r->strm.avail_in == 0) {
+	 if ((n = zidx_fill(r)) < 0)
+	    return -1;
+	 if (n == 0) {
+	    r->eof = 1;
+	    break;
+	 }
+      }
+
+      ret = inflate(&r->strm, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+	 /*
+	  * Raw inflation leaves the trailer of the member. The next member,
+	  * if any, starts with a gzip header.
+	  */
+	 if ((r->raw && !zidx_skip(r, 8)) ||
+	     (r->strm.avail_in == 0 && zidx_fill(r) <= 0) ||
+	     r->strm.next_in[0] != 0x1f) {
+	    r->eof = 1;
+	    break;
+	 }
+
+	 inflateReset2(&r->strm, 31);
+	 r->raw = 0;
+	 continue;
+      }
+
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+	 err_msg("inflate: %s", r->strm.msg ? r->strm.msg : "error");
+	 return -1;
+      }
+   }
+
+   return len - r->strm.avail_out;
+}
+
+/**
+ * Close a reader.
+ * @param r reader
+ */
+void zidx_end(zidx_reader_t * r)
+{
+   if (!r)
+      return;
+
+   inflateEnd(&r->strm);
+   free(r);
+}
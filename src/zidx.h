@@ -0,0 +1,81 @@
+/*
+ * Pseudonymizer for Solaris BSM Audit Logs, http://www.roqe.org/bsmpseu
+ * Copyright 2002, 2003 Konrad Rieck <kr@roqe.org> - All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * $Id$
+ */
+
+/**
+ * @file zidx.h Access point index for gzip files header.
+ *
+ * @author Konrad Rieck
+ * @version $Id$
+ */
+
+#ifndef _ZIDX_H
+#define _ZIDX_H
+
+#define ZIDX_MAGIC        "BSMZIDX\2"	/**< Magic of index files */
+#define ZIDX_SUFFIX       ".zidx"	/**< Suffix of cached index files */
+#define ZIDX_SPAN         (4 << 20)	/**< Distance of access points */
+#define ZIDX_WINDOW       32768		/**< Size of a deflate window */
+#define ZIDX_CHUNK        65536		/**< Size of compressed reads */
+#define ZIDX_HEADER_SIZE  40		/**< Size of file header */
+#define ZIDX_ENTRY_SIZE   (20 + ZIDX_WINDOW)	/**< Size of an entry */
+
+/**
+ * Access point of a gzip file. Decompression can start at a point with
+ * the window of uncompressed data preceding it. If the point is not at a
+ * byte boundary, bits of the previous byte belong to it.
+ */
+typedef struct {
+   uint64_t out;		     /**< Offset in uncompressed data */
+   uint64_t in;			     /**< Offset in compressed file */
+   int bits;			     /**< Bits of previous byte, 0 to 7 */
+} zidx_point_t;
+
+/**
+ * Access point index of a gzip file. The windows of the points are kept
+ * in the index file and are only read when a point is used.
+ */
+typedef struct s_zidx {
+   FILE *fp;			     /**< Index file */
+   unsigned int num;		     /**< Number of points */
+   uint64_t size;		     /**< Size of uncompressed data */
+   zidx_point_t *points;	     /**< Access points */
+} zidx_t;
+
+/**
+ * Reader decompressing a gzip file from an access point. Members
+ * following the one of the point are decompressed as well.
+ */
+typedef struct s_zidx_reader {
+   z_stream strm;		     /**< Inflate state */
+   int fd;			     /**< Compressed file */
+   uint64_t pos;		     /**< Offset of next read in file */
+   int raw;			     /**< Inflating raw deflate data */
+   int eof;			     /**< End of data reached */
+   uchar_t buf[ZIDX_CHUNK];	     /**< Compressed data */
+} zidx_reader_t;
+
+zidx_t *zidx_open(char *name, int fd, int build);
+void zidx_close(zidx_t * x);
+zidx_reader_t *zidx_seek(zidx_t * x, int fd, uint64_t offset);
+int zidx_read(zidx_reader_t * r, uchar_t * buf, int len);
+void zidx_end(zidx_reader_t * r);
+
+#endif				/* _ZIDX_H */